@@ -0,0 +1,551 @@
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <xcb/xcb.h>
+
+/**
+ * @file budget_check.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Check that howm's frequently used operations stay within their X
+ * request budgets, as run by make check.
+ *
+ * An Xvfb server and howm are started, then a second X client runs each of
+ * the following scenarios in turn:
+ *
+ * map: Map 50 windows on the first workspace.
+ *
+ * change_ws: Map 5 windows on the second workspace, then switch between the
+ * two workspaces.
+ *
+ * focus: Send focus_next_client 100 times.
+ *
+ * fullscreen: Toggle the focused client's fullscreen state on and off.
+ *
+ * cut_paste: Cut 5 clients with op_cut, then paste them onto the second
+ * workspace.
+ *
+ * The counts are cleared with the xstats query before each scenario and read
+ * back afterwards. A scenario fails if an operation that it needs wasn't run,
+ * or if howm counted any call of an operation with a budget as going over it.
+ * Only howm knows how many clients were on the workspaces that each call
+ * touched, so the request limit is left to its over_budget count. A call
+ * making more round trips than its budget also fails the scenario.
+ *
+ * Each line of output holds the scenario, an operation, its amount of calls,
+ * the most requests made by one call, the most round trips made by one call
+ * and their limit, then the amount of calls that went over budget. The exit
+ * status is non-zero if any scenario failed.
+ */
+
+/** How long to wait for howm to react to a window being mapped. */
+#define TIMEOUT_MS 2000
+/** How long to wait for Xvfb and howm to start. */
+#define STARTUP_MS 10000
+/** The largest xstats reply that will be read. */
+#define JSON_SIZE (64 * 1024)
+
+struct expect {
+	const char *op; /**< The name of the operation, as used by xstats. */
+	unsigned int calls; /**< The least amount of calls that must be counted. */
+};
+
+struct scenario {
+	const char *name;
+	void (*setup)(void); /**< Run before the counts are cleared, or NULL. */
+	void (*run)(void);
+	struct expect expect[3]; /**< Terminated by an entry without an op. */
+};
+
+static xcb_connection_t *dpy;
+static xcb_screen_t *screen;
+static const char *sock_path = "/tmp/howm";
+static double quiet = 0.05;
+static pid_t xvfb_pid, howm_pid;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static pid_t start(char *const argv[])
+{
+	pid_t pid = fork();
+
+	if (pid == -1) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	} else if (pid == 0) {
+		execvp(argv[0], argv);
+		perror(argv[0]);
+		_exit(EXIT_FAILURE);
+	}
+	return pid;
+}
+
+static void sleep_ms(long ms)
+{
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+
+	nanosleep(&ts, NULL);
+}
+
+static void stop(pid_t pid)
+{
+	if (pid <= 0)
+		return;
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+}
+
+static void stop_all(void)
+{
+	if (dpy)
+		xcb_disconnect(dpy);
+	dpy = NULL;
+	stop(howm_pid);
+	stop(xvfb_pid);
+	howm_pid = xvfb_pid = 0;
+}
+
+static int connect_howm(void)
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd == -1)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock_path);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int connect_or_die(void)
+{
+	int fd = connect_howm();
+
+	if (fd == -1) {
+		perror("connect");
+		stop_all();
+		exit(EXIT_FAILURE);
+	}
+	return fd;
+}
+
+/**
+ * @brief Send a command to howm using the text protocol, in the same way as
+ * cottage does.
+ *
+ * @param cmd The name of the command.
+ * @param arg Its arg, or NULL.
+ */
+static void send_cmd(const char *cmd, const char *arg)
+{
+	char msg[128];
+	int len = 2, ret, fd = connect_or_die();
+
+	/* MSG_FUNCTION, the command name and its arg, each NULL terminated. */
+	msg[0] = 1;
+	msg[1] = '\0';
+	len += snprintf(msg + len, sizeof(msg) - len, "%s", cmd) + 1;
+	if (arg)
+		len += snprintf(msg + len, sizeof(msg) - len, "%s", arg) + 1;
+	if (write(fd, msg, len) != len || read(fd, &ret, sizeof(ret)) != sizeof(ret))
+		fprintf(stderr, "%s: short transfer\n", cmd);
+	else if (ret != 0)
+		fprintf(stderr, "%s: howm replied with error %d\n", cmd, ret);
+	close(fd);
+}
+
+/**
+ * @brief Run howm's xstats query.
+ *
+ * @param reset Clear the counts once they have been sent.
+ * @param json Filled with the reply, which is NULL terminated.
+ *
+ * @return False if howm couldn't be asked.
+ */
+static bool query_xstats(bool reset, char *json)
+{
+	/* MSG_QUERY followed by the name of the query and its arg. */
+	static const char msg[] = "\4\0xstats\0reset";
+	size_t size = reset ? sizeof(msg) : sizeof("\4\0xstats");
+	size_t got = 0;
+	uint32_t len;
+	ssize_t n;
+	int err, fd = connect_or_die();
+
+	if (write(fd, msg, size) != (ssize_t)size
+			|| read(fd, &err, sizeof(err)) != sizeof(err) || err != 0
+			|| read(fd, &len, sizeof(len)) != sizeof(len)
+			|| len >= JSON_SIZE) {
+		close(fd);
+		return false;
+	}
+	while (got < len && (n = read(fd, json + got, len - got)) > 0)
+		got += n;
+	close(fd);
+	json[got] = '\0';
+	return got == len;
+}
+
+/**
+ * @brief Find a number in a JSON object.
+ *
+ * @param p The start of the object.
+ * @param end The end of the object.
+ * @param key The key, including its quotes and the colon.
+ * @param val Set to the number.
+ *
+ * @return False if the key isn't in the object.
+ */
+static bool json_ulong(const char *p, const char *end, const char *key,
+		unsigned long *val)
+{
+	p = strstr(p, key);
+	if (!p || p >= end)
+		return false;
+	*val = strtoul(p + strlen(key), NULL, 10);
+	return true;
+}
+
+/**
+ * @brief Wait for the next event, until the deadline passes.
+ *
+ * @param deadline A time from now().
+ *
+ * @return The event, which must be freed, or NULL on timeout.
+ */
+static xcb_generic_event_t *next_event(double deadline)
+{
+	struct pollfd pfd = { .fd = xcb_get_file_descriptor(dpy), .events = POLLIN };
+	xcb_generic_event_t *ev;
+	double left;
+
+	for (;;) {
+		ev = xcb_poll_for_event(dpy);
+		if (ev)
+			return ev;
+		if (xcb_connection_has_error(dpy)) {
+			fprintf(stderr, "Lost the X connection\n");
+			stop_all();
+			exit(EXIT_FAILURE);
+		}
+		left = deadline - now();
+		if (left <= 0)
+			return NULL;
+		poll(&pfd, 1, (int)(left * 1000) + 1);
+	}
+}
+
+/**
+ * @brief Wait until a window has been mapped and howm has stopped configuring
+ * windows.
+ *
+ * @return False on timeout.
+ */
+static bool wait_mapped(xcb_window_t win)
+{
+	xcb_generic_event_t *ev;
+	double deadline = now() + TIMEOUT_MS / 1000.0;
+	bool done = false;
+
+	while ((ev = next_event(deadline))) {
+		switch (ev->response_type & ~0x80) {
+		case XCB_CONFIGURE_NOTIFY:
+			if (done)
+				deadline = now() + quiet;
+			break;
+		case XCB_MAP_NOTIFY:
+			if (((xcb_map_notify_event_t *)ev)->window == win) {
+				done = true;
+				deadline = now() + quiet;
+			}
+			break;
+		}
+		free(ev);
+	}
+	return done;
+}
+
+/**
+ * @brief Wait until nothing has happened for the quiet period, so that howm
+ * has finished any redraw that it deferred.
+ */
+static void drain(void)
+{
+	xcb_generic_event_t *ev;
+
+	xcb_flush(dpy);
+	while ((ev = next_event(now() + quiet)))
+		free(ev);
+}
+
+static void map_windows(unsigned int n)
+{
+	uint32_t mask = XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+	xcb_window_t win;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		win = xcb_generate_id(dpy);
+		xcb_create_window(dpy, XCB_COPY_FROM_PARENT, win, screen->root,
+				0, 0, 100, 100, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+				screen->root_visual, XCB_CW_EVENT_MASK, &mask);
+		xcb_map_window(dpy, win);
+		xcb_flush(dpy);
+		if (!wait_mapped(win))
+			fprintf(stderr, "Window %u wasn't mapped\n", win);
+	}
+}
+
+static void run_map(void)
+{
+	send_cmd("change_ws", "1");
+	map_windows(50);
+}
+
+static void setup_change_ws(void)
+{
+	send_cmd("change_ws", "2");
+	map_windows(5);
+	send_cmd("change_ws", "1");
+	drain();
+}
+
+static void run_change_ws(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < 10; i++) {
+		send_cmd("change_ws", "2");
+		send_cmd("change_ws", "1");
+	}
+}
+
+static void run_focus(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < 100; i++)
+		send_cmd("focus_next_client", NULL);
+}
+
+static void run_fullscreen(void)
+{
+	send_cmd("toggle_fullscreen", NULL);
+	drain();
+	send_cmd("toggle_fullscreen", NULL);
+}
+
+static void run_cut_paste(void)
+{
+	send_cmd("operate", "d5c");
+	send_cmd("change_ws", "2");
+	send_cmd("paste", NULL);
+}
+
+static const struct scenario scenarios[] = {
+	{ "map", NULL, run_map, { { "map_request", 50 } } },
+	{ "change_ws", setup_change_ws, run_change_ws, { { "change_ws", 20 } } },
+	{ "focus", NULL, run_focus, { { "focus_next_client", 100 } } },
+	{ "fullscreen", NULL, run_fullscreen, { { "toggle_fullscreen", 2 } } },
+	{ "cut_paste", NULL, run_cut_paste,
+		{ { "operate", 1 }, { "change_ws", 1 }, { "paste", 1 } } },
+};
+
+/**
+ * @brief Check one operation from the xstats reply against its budget.
+ *
+ * @param s The scenario that was run.
+ * @param op The start of the operation's object.
+ * @param end The end of the operation's object.
+ *
+ * @return False if the operation went over its budget.
+ */
+static bool check_op(const struct scenario *s, const char *op, const char *end)
+{
+	unsigned long calls = 0, reqs = 0, rts = 0, over = 0;
+	unsigned long budget_rts = 0;
+	const char *name = op + strlen("{\"op\":\""), *b;
+	int name_len = strcspn(name, "\"");
+	bool ok;
+
+	json_ulong(op, end, "\"calls\":", &calls);
+	json_ulong(op, end, "\"max_requests\":", &reqs);
+	json_ulong(op, end, "\"max_round_trips\":", &rts);
+	b = strstr(op, "\"budget\":");
+	if (!b || b >= end)
+		return true;
+	json_ulong(b, end, "\"round_trips\":", &budget_rts);
+	json_ulong(b, end, "\"over_budget\":", &over);
+
+	ok = rts <= budget_rts && !over;
+	printf("%s %.*s %lu %lu %lu/%lu %lu%s\n", s->name, name_len, name,
+			calls, reqs, rts, budget_rts, over, ok ? "" : " OVER");
+	if (over)
+		fprintf(stderr, "%s: howm counted %.*s over its budget %lu times\n",
+				s->name, name_len, name, over);
+	return ok;
+}
+
+/**
+ * @brief Run a scenario and check the requests that it made.
+ *
+ * @return False if the scenario failed.
+ */
+static bool run_scenario(const struct scenario *s, char *json)
+{
+	const struct expect *e;
+	const char *op, *next, *end;
+	unsigned long calls;
+	char key[64];
+	bool ok = true;
+
+	if (s->setup)
+		s->setup();
+	if (!query_xstats(true, json)) {
+		fprintf(stderr, "Can't run howm's xstats query on %s\n", sock_path);
+		return false;
+	}
+	s->run();
+	drain();
+	if (!query_xstats(false, json)) {
+		fprintf(stderr, "Can't run howm's xstats query on %s\n", sock_path);
+		return false;
+	}
+
+	for (e = s->expect; e->op; e++) {
+		snprintf(key, sizeof(key), "{\"op\":\"%s\"", e->op);
+		op = strstr(json, key);
+		if (!op || !json_ulong(op, op + strlen(op), "\"calls\":", &calls)
+				|| calls < e->calls) {
+			fprintf(stderr, "%s: expected %u calls of %s\n", s->name,
+					e->calls, e->op);
+			ok = false;
+		}
+	}
+
+	for (op = strstr(json, "{\"op\":\""); op; op = next) {
+		next = strstr(op + 1, "{\"op\":\"");
+		end = next ? next : op + strlen(op);
+		if (!check_op(s, op, end))
+			ok = false;
+	}
+	return ok;
+}
+
+/**
+ * @brief Start Xvfb and then howm, waiting until both are ready.
+ */
+static void start_servers(char *xvfb, char *display, char *howm, char *config)
+{
+	char *xvfb_argv[] = { xvfb, display, "-screen", "0", "1920x1080x24",
+		"-nolisten", "tcp", NULL };
+	char *howm_argv[] = { howm, config ? "-c" : NULL, config, NULL };
+	double deadline = now() + STARTUP_MS / 1000.0;
+	int fd;
+
+	xvfb_pid = start(xvfb_argv);
+	do {
+		if (dpy)
+			xcb_disconnect(dpy);
+		sleep_ms(10);
+		dpy = xcb_connect(display, NULL);
+	} while (xcb_connection_has_error(dpy) && now() < deadline);
+	if (xcb_connection_has_error(dpy)) {
+		fprintf(stderr, "Couldn't connect to Xvfb on %s\n", display);
+		stop_all();
+		exit(EXIT_FAILURE);
+	}
+	screen = xcb_setup_roots_iterator(xcb_get_setup(dpy)).data;
+
+	unlink(sock_path);
+	setenv("DISPLAY", display, 1);
+	howm_pid = start(howm_argv);
+	while ((fd = connect_howm()) == -1 && now() < deadline)
+		sleep_ms(10);
+	if (fd == -1) {
+		fprintf(stderr, "howm didn't start listening on %s\n", sock_path);
+		stop_all();
+		exit(EXIT_FAILURE);
+	}
+	close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+	char *xvfb = "Xvfb", *display = ":99", *howm = "./howm", *config = NULL;
+	char *json;
+	unsigned int i, failed = 0;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "X:d:w:c:s:q:")) != -1) {
+		switch (ch) {
+		case 'X':
+			xvfb = optarg;
+			break;
+		case 'd':
+			display = optarg;
+			break;
+		case 'w':
+			howm = optarg;
+			break;
+		case 'c':
+			config = optarg;
+			break;
+		case 's':
+			sock_path = optarg;
+			break;
+		case 'q':
+			quiet = strtoul(optarg, NULL, 10) / 1000.0;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-X Xvfb] [-d display] [-w howm] [-c config]\n"
+					"\t[-s socket] [-q quiet ms]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	json = malloc(JSON_SIZE);
+	if (!json) {
+		perror("malloc");
+		return EXIT_FAILURE;
+	}
+	start_servers(xvfb, display, howm, config);
+	printf("# scenario op calls max_requests max_round_trips/limit over_budget\n");
+	for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+		if (!run_scenario(&scenarios[i], json)) {
+			fprintf(stderr, "%s: FAILED\n", scenarios[i].name);
+			failed++;
+		}
+	}
+	stop_all();
+	free(json);
+
+	printf("# %u of %zu scenarios failed\n", failed,
+			sizeof(scenarios) / sizeof(scenarios[0]));
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
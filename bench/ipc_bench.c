@@ -0,0 +1,144 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "ipc.h"
+
+/**
+ * @file ipc_bench.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Measure how many IPC messages per second a running instance of howm
+ * can process, using both the text and the binary protocols.
+ *
+ * The text protocol is driven the same way as cottage drives it: one
+ * connection per message. The binary protocol pipelines frames over a single
+ * connection.
+ */
+
+/** How many frames to send before waiting for their replies. */
+#define BATCH 64
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connect_howm(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd == -1) {
+		perror("socket");
+		exit(EXIT_FAILURE);
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		perror("connect");
+		exit(EXIT_FAILURE);
+	}
+	return fd;
+}
+
+static double bench_text(const char *path, const char *cmd, long n)
+{
+	char msg[64];
+	int len, ret, fd;
+	long i;
+	double start;
+
+	/* MSG_FUNCTION and the command name, each NULL terminated. */
+	msg[0] = 1;
+	msg[1] = '\0';
+	len = snprintf(msg + 2, sizeof(msg) - 2, "%s", cmd) + 3;
+	start = now();
+	for (i = 0; i < n; i++) {
+		fd = connect_howm(path);
+		if (write(fd, msg, len) != len || read(fd, &ret, sizeof(ret)) != sizeof(ret)) {
+			fprintf(stderr, "text: short transfer\n");
+			exit(EXIT_FAILURE);
+		}
+		close(fd);
+	}
+	return n / (now() - start);
+}
+
+static double bench_bin(const char *path, unsigned int opcode, long n)
+{
+	unsigned char frames[BATCH * IPC_BIN_HDR_SIZE];
+	int32_t replies[BATCH];
+	long i, batch;
+	ssize_t want, got;
+	int fd = connect_howm(path);
+	double start;
+
+	for (i = 0; i < BATCH; i++) {
+		unsigned char *f = frames + i * IPC_BIN_HDR_SIZE;
+
+		memset(f, 0, IPC_BIN_HDR_SIZE);
+		f[0] = IPC_BIN_MAGIC;
+		f[1] = IPC_BIN_VERSION;
+		f[2] = opcode & 0xFF;
+		f[3] = (opcode >> 8) & 0xFF;
+	}
+
+	start = now();
+	for (i = 0; i < n; i += batch) {
+		batch = (n - i) < BATCH ? (n - i) : BATCH;
+		if (write(fd, frames, batch * IPC_BIN_HDR_SIZE) != batch * IPC_BIN_HDR_SIZE) {
+			fprintf(stderr, "binary: short write\n");
+			exit(EXIT_FAILURE);
+		}
+		for (want = batch * sizeof(int32_t); want > 0; want -= got) {
+			got = read(fd, (char *)replies + (batch * sizeof(int32_t) - want), want);
+			if (got <= 0) {
+				fprintf(stderr, "binary: connection closed\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	close(fd);
+	return n / (now() - start);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = "/tmp/howm";
+	long n = 10000;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "s:n:")) != -1) {
+		switch (ch) {
+		case 's':
+			path = optarg;
+			break;
+		case 'n':
+			n = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-s socket] [-n messages]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* focus_urgent is cheap and has no visible effect when nothing is
+	 * urgent, so it measures the protocol rather than the WM. */
+	printf("text   %12.0f msg/s\n", bench_text(path, "focus_urgent", n));
+	printf("binary %12.0f msg/s\n", bench_bin(path, IPC_OP_FOCUS_URGENT, n));
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,459 @@
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <xcb/xcb.h>
+
+/**
+ * @file latency_bench.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Measure how long howm takes to react, as seen by an X client.
+ *
+ * An Xvfb server and howm are started, then a second X client creates, maps
+ * and destroys windows while sending IPC commands. The following latencies
+ * are measured:
+ *
+ * map: From MapWindow until the window has its final tiled geometry. The
+ * geometry is final once no ConfigureNotify has arrived for the quiet period.
+ *
+ * focus_next_client and change_ws: From sending the command over IPC until
+ * one of the windows receives FocusIn.
+ *
+ * destroy: From DestroyWindow until the remaining windows have been retiled,
+ * again using the quiet period.
+ *
+ * Each line of output holds a metric's name, its amount of samples and
+ * timeouts, followed by its minimum, median, 90th percentile, 99th percentile
+ * and maximum in microseconds.
+ */
+
+/** How long to wait for howm to react before giving up on a sample. */
+#define TIMEOUT_MS 2000
+/** How long to wait for Xvfb and howm to start. */
+#define STARTUP_MS 10000
+
+struct samples {
+	const char *name;
+	double *v; /**< Latencies in seconds. */
+	size_t n;
+	size_t cap;
+	unsigned int timeouts;
+};
+
+static xcb_connection_t *dpy;
+static xcb_screen_t *screen;
+static const char *sock_path = "/tmp/howm";
+static double quiet = 0.05;
+static pid_t xvfb_pid, howm_pid;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void add_sample(struct samples *s, double v)
+{
+	if (s->n == s->cap) {
+		s->cap = s->cap ? s->cap * 2 : 64;
+		s->v = realloc(s->v, s->cap * sizeof(double));
+		if (!s->v) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	s->v[s->n++] = v;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double percentile(const struct samples *s, unsigned int pct)
+{
+	size_t i = (s->n * pct) / 100;
+
+	return s->v[i < s->n ? i : s->n - 1] * 1e6;
+}
+
+static void report(struct samples *s)
+{
+	if (!s->n) {
+		printf("%s 0 %u - - - - -\n", s->name, s->timeouts);
+		return;
+	}
+	qsort(s->v, s->n, sizeof(double), cmp_double);
+	printf("%s %zu %u %.0f %.0f %.0f %.0f %.0f\n", s->name, s->n, s->timeouts,
+			s->v[0] * 1e6, percentile(s, 50), percentile(s, 90),
+			percentile(s, 99), s->v[s->n - 1] * 1e6);
+}
+
+static pid_t start(char *const argv[])
+{
+	pid_t pid = fork();
+
+	if (pid == -1) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	} else if (pid == 0) {
+		execvp(argv[0], argv);
+		perror(argv[0]);
+		_exit(EXIT_FAILURE);
+	}
+	return pid;
+}
+
+static void sleep_ms(long ms)
+{
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+
+	nanosleep(&ts, NULL);
+}
+
+static void stop(pid_t pid)
+{
+	if (pid <= 0)
+		return;
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+}
+
+static void stop_all(void)
+{
+	if (dpy)
+		xcb_disconnect(dpy);
+	dpy = NULL;
+	stop(howm_pid);
+	stop(xvfb_pid);
+	howm_pid = xvfb_pid = 0;
+}
+
+static int connect_howm(void)
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd == -1)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock_path);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * @brief Send a command to howm using the text protocol, in the same way as
+ * cottage does.
+ *
+ * @param cmd The name of the command.
+ * @param arg Its arg, or NULL.
+ */
+static void send_cmd(const char *cmd, const char *arg)
+{
+	char msg[128];
+	int len = 2, ret, fd = connect_howm();
+
+	if (fd == -1) {
+		perror("connect");
+		stop_all();
+		exit(EXIT_FAILURE);
+	}
+	/* MSG_FUNCTION, the command name and its arg, each NULL terminated. */
+	msg[0] = 1;
+	msg[1] = '\0';
+	len += snprintf(msg + len, sizeof(msg) - len, "%s", cmd) + 1;
+	if (arg)
+		len += snprintf(msg + len, sizeof(msg) - len, "%s", arg) + 1;
+	if (write(fd, msg, len) != len || read(fd, &ret, sizeof(ret)) != sizeof(ret))
+		fprintf(stderr, "%s: short transfer\n", cmd);
+	else if (ret != 0)
+		fprintf(stderr, "%s: howm replied with error %d\n", cmd, ret);
+	close(fd);
+}
+
+/**
+ * @brief Wait for the next event, until the deadline passes.
+ *
+ * @param deadline A time from now().
+ *
+ * @return The event, which must be freed, or NULL on timeout.
+ */
+static xcb_generic_event_t *next_event(double deadline)
+{
+	struct pollfd pfd = { .fd = xcb_get_file_descriptor(dpy), .events = POLLIN };
+	xcb_generic_event_t *ev;
+	double left;
+
+	for (;;) {
+		ev = xcb_poll_for_event(dpy);
+		if (ev)
+			return ev;
+		if (xcb_connection_has_error(dpy)) {
+			fprintf(stderr, "Lost the X connection\n");
+			stop_all();
+			exit(EXIT_FAILURE);
+		}
+		left = deadline - now();
+		if (left <= 0)
+			return NULL;
+		poll(&pfd, 1, (int)(left * 1000) + 1);
+	}
+}
+
+/**
+ * @brief Wait until howm stops configuring windows.
+ *
+ * @param win For map, the window that must be mapped. XCB_NONE otherwise.
+ * @param t0 When the action that howm is reacting to was sent.
+ *
+ * @return The time of the last ConfigureNotify (or MapNotify), or a negative
+ * number on timeout.
+ */
+static double wait_settled(xcb_window_t win, double t0)
+{
+	xcb_generic_event_t *ev;
+	double last = -1, deadline = t0 + TIMEOUT_MS / 1000.0;
+	bool mapped = win == XCB_NONE;
+
+	while ((ev = next_event(deadline))) {
+		switch (ev->response_type & ~0x80) {
+		case XCB_CONFIGURE_NOTIFY:
+			last = now();
+			break;
+		case XCB_MAP_NOTIFY:
+			if (((xcb_map_notify_event_t *)ev)->window == win) {
+				mapped = true;
+				if (last < 0)
+					last = now();
+			}
+			break;
+		}
+		free(ev);
+		if (mapped && last > 0)
+			deadline = last + quiet;
+	}
+	return mapped ? last : -1;
+}
+
+/**
+ * @brief Wait for one of our windows to be given the input focus.
+ *
+ * @return The time that FocusIn arrived, or a negative number on timeout.
+ */
+static double wait_focus(double t0)
+{
+	xcb_generic_event_t *ev;
+	xcb_focus_in_event_t *fe;
+	double deadline = t0 + TIMEOUT_MS / 1000.0;
+
+	while ((ev = next_event(deadline))) {
+		fe = (xcb_focus_in_event_t *)ev;
+		if ((ev->response_type & ~0x80) == XCB_FOCUS_IN
+				&& fe->detail != XCB_NOTIFY_DETAIL_POINTER) {
+			free(ev);
+			return now();
+		}
+		free(ev);
+	}
+	return -1;
+}
+
+static void record(struct samples *s, double t0, double t)
+{
+	if (t < 0)
+		s->timeouts++;
+	else
+		add_sample(s, t - t0);
+}
+
+static void drain(void)
+{
+	xcb_generic_event_t *ev;
+
+	xcb_flush(dpy);
+	while ((ev = next_event(now() + quiet)))
+		free(ev);
+}
+
+static xcb_window_t map_window(struct samples *s)
+{
+	uint32_t mask = XCB_EVENT_MASK_STRUCTURE_NOTIFY | XCB_EVENT_MASK_FOCUS_CHANGE;
+	xcb_window_t win = xcb_generate_id(dpy);
+	double t0;
+
+	xcb_create_window(dpy, XCB_COPY_FROM_PARENT, win, screen->root, 0, 0,
+			100, 100, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+			screen->root_visual, XCB_CW_EVENT_MASK, &mask);
+	drain();
+	t0 = now();
+	xcb_map_window(dpy, win);
+	xcb_flush(dpy);
+	record(s, t0, wait_settled(win, t0));
+	return win;
+}
+
+static void run_round(unsigned int n, struct samples *map, struct samples *focus,
+		struct samples *ws, struct samples *destroy)
+{
+	xcb_window_t wins[n], other;
+	unsigned int i;
+	double t0;
+
+	send_cmd("change_ws", "1");
+	for (i = 0; i < n; i++)
+		wins[i] = map_window(map);
+
+	for (i = 0; i < n; i++) {
+		drain();
+		t0 = now();
+		send_cmd("focus_next_client", NULL);
+		record(focus, t0, wait_focus(t0));
+	}
+
+	send_cmd("change_ws", "2");
+	other = map_window(map);
+	for (i = 0; i < n; i++) {
+		drain();
+		t0 = now();
+		send_cmd("change_ws", i % 2 ? "2" : "1");
+		record(ws, t0, wait_focus(t0));
+	}
+	send_cmd("change_ws", "2");
+	xcb_destroy_window(dpy, other);
+	send_cmd("change_ws", "1");
+
+	for (i = 0; i < n; i++) {
+		drain();
+		t0 = now();
+		xcb_destroy_window(dpy, wins[i]);
+		xcb_flush(dpy);
+		/* The last window has nothing left to retile. */
+		if (i < n - 1)
+			record(destroy, t0, wait_settled(XCB_NONE, t0));
+	}
+	drain();
+}
+
+/**
+ * @brief Start Xvfb and then howm, waiting until both are ready.
+ */
+static void start_servers(char *xvfb, char *display, char *howm, char *config)
+{
+	char *xvfb_argv[] = { xvfb, display, "-screen", "0", "1920x1080x24",
+		"-nolisten", "tcp", NULL };
+	char *howm_argv[] = { howm, config ? "-c" : NULL, config, NULL };
+	double deadline = now() + STARTUP_MS / 1000.0;
+	int fd;
+
+	xvfb_pid = start(xvfb_argv);
+	do {
+		if (dpy)
+			xcb_disconnect(dpy);
+		sleep_ms(10);
+		dpy = xcb_connect(display, NULL);
+	} while (xcb_connection_has_error(dpy) && now() < deadline);
+	if (xcb_connection_has_error(dpy)) {
+		fprintf(stderr, "Couldn't connect to Xvfb on %s\n", display);
+		stop_all();
+		exit(EXIT_FAILURE);
+	}
+	screen = xcb_setup_roots_iterator(xcb_get_setup(dpy)).data;
+
+	unlink(sock_path);
+	setenv("DISPLAY", display, 1);
+	howm_pid = start(howm_argv);
+	while ((fd = connect_howm()) == -1 && now() < deadline)
+		sleep_ms(10);
+	if (fd == -1) {
+		fprintf(stderr, "howm didn't start listening on %s\n", sock_path);
+		stop_all();
+		exit(EXIT_FAILURE);
+	}
+	close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+	char *xvfb = "Xvfb", *display = ":99", *howm = "./howm", *config = NULL;
+	unsigned int n = 10, rounds = 10, i;
+	struct samples map = { .name = "map" };
+	struct samples focus = { .name = "focus_next_client" };
+	struct samples ws = { .name = "change_ws" };
+	struct samples destroy = { .name = "destroy" };
+	int ch;
+
+	while ((ch = getopt(argc, argv, "X:d:w:c:s:n:r:q:")) != -1) {
+		switch (ch) {
+		case 'X':
+			xvfb = optarg;
+			break;
+		case 'd':
+			display = optarg;
+			break;
+		case 'w':
+			howm = optarg;
+			break;
+		case 'c':
+			config = optarg;
+			break;
+		case 's':
+			sock_path = optarg;
+			break;
+		case 'n':
+			n = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		case 'q':
+			quiet = strtoul(optarg, NULL, 10) / 1000.0;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-X Xvfb] [-d display] [-w howm] [-c config]\n"
+					"\t[-s socket] [-n windows] [-r rounds] [-q quiet ms]\n",
+					argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (n < 2) {
+		fprintf(stderr, "At least two windows are needed to change focus\n");
+		return EXIT_FAILURE;
+	}
+
+	start_servers(xvfb, display, howm, config);
+	for (i = 0; i < rounds; i++)
+		run_round(n, &map, &focus, &ws, &destroy);
+	stop_all();
+
+	printf("# windows %u rounds %u quiet_ms %.0f\n", n, rounds, quiet * 1000);
+	printf("# metric samples timeouts min_us p50_us p90_us p99_us max_us\n");
+	report(&map);
+	report(&focus);
+	report(&ws);
+	report(&destroy);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_ewmh.h>
+
+#include "howm.h"
+#include "client.h"
+#include "layout.h"
+#include "helper.h"
+#include "types.h"
+#include "xstats.h"
+
+/**
+ * @file layout_bench.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Measure how long each of howm's layouts (and draw_clients() on its
+ * own) takes to arrange a workspace, along with how many X requests it sends.
+ *
+ * The benchmark is linked against howm's own objects. Its X connection is one
+ * that failed to connect, on which libxcb discards every request, so only
+ * howm's side of the work is measured. Requests are counted by
+ * xstats, in the same way as they are in howm.
+ *
+ * Output is one line per case, with whitespace separated columns, so that
+ * runs of different builds can be compared with standard tools.
+ */
+
+/** The default amount of client arrangements performed per case. */
+#define WORK 1048576
+
+static const unsigned int sizes[] = { 1, 2, 8, 64, 512, 4096 };
+
+static const struct {
+	const char *name;
+	unsigned int floating; /**< Percentage of floating clients. */
+	unsigned int fullscreen; /**< Percentage of fullscreen clients. */
+} mixes[] = {
+	{ "tiled", 0, 0 },
+	{ "mixed", 10, 5 },
+	{ "floaty", 50, 10 },
+};
+
+static const struct {
+	const char *name;
+	int layout;
+	bool draw_only; /**< Only call draw_clients(), without a layout. */
+} cases[] = {
+	{ "zoom", ZOOM, false },
+	{ "grid", GRID, false },
+	{ "hstack", HSTACK, false },
+	{ "vstack", VSTACK, false },
+	{ "draw", VSTACK, true },
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Does the i'th of n clients fall into the first pct percent, spread
+ * evenly through the list?
+ */
+static bool spread(unsigned int i, unsigned int pct)
+{
+	return (i + 1) * pct / 100 != i * pct / 100;
+}
+
+static void fill_ws(unsigned int n, unsigned int floating, unsigned int fullscreen)
+{
+	Client *c, *prev = NULL;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		c = calloc(1, sizeof(Client));
+		if (!c) {
+			perror("calloc");
+			exit(EXIT_FAILURE);
+		}
+		c->win = 0x200000 + i;
+		c->w = c->h = 100;
+		c->gap = conf.op_gap_size;
+		c->is_fullscreen = spread(i, fullscreen);
+		c->is_floating = !c->is_fullscreen && spread(i, floating);
+		if (prev)
+			prev->next = c;
+		else
+			wss[cw].head = c;
+		prev = c;
+	}
+	wss[cw].client_cnt = n;
+	wss[cw].current = wss[cw].head;
+}
+
+static void empty_ws(void)
+{
+	Client *c, *next;
+
+	for (c = wss[cw].head; c; c = next) {
+		next = c->next;
+		free(c);
+	}
+	wss[cw].head = wss[cw].current = wss[cw].prev_foc = NULL;
+	wss[cw].client_cnt = 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct xstats_op *o = xstats_get(XSTATS_OTHER);
+	unsigned long work = WORK, iters, i;
+	unsigned int s, m, k;
+	uint32_t start_reqs;
+	double start;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			work = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n client arrangements per case]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* An unparsable display name gives a connection in an error state. */
+	dpy = xcb_connect("howm-bench", NULL);
+	ewmh = calloc(1, sizeof(xcb_ewmh_connection_t));
+	if (!ewmh) {
+		perror("calloc");
+		return EXIT_FAILURE;
+	}
+	ewmh->connection = dpy;
+	conf.log_level = LOG_NONE;
+	screen_width = 1920;
+	screen_height = 1080;
+	cw = 1;
+	wss[cw].master_ratio = 0.6;
+	wss[cw].bar_height = 20;
+
+	printf("# case clients mix floating%% fullscreen%% ns/arrange requests/arrange\n");
+	for (s = 0; s < LENGTH(sizes); s++) {
+		for (m = 0; m < LENGTH(mixes); m++) {
+			fill_ws(sizes[s], mixes[m].floating, mixes[m].fullscreen);
+			iters = work / sizes[s] ? work / sizes[s] : 1;
+			for (k = 0; k < LENGTH(cases); k++) {
+				wss[cw].layout = cases[k].layout;
+				start_reqs = o->requests;
+				start = now();
+				for (i = 0; i < iters; i++) {
+					if (cases[k].draw_only)
+						draw_clients();
+					else
+						arrange_windows();
+				}
+				printf("%s %u %s %u %u %.1f %.1f\n", cases[k].name,
+						sizes[s], mixes[m].name,
+						mixes[m].floating, mixes[m].fullscreen,
+						(now() - start) * 1e9 / iters,
+						(double)(o->requests - start_reqs) / iters);
+			}
+			empty_ws();
+		}
+	}
+
+	xcb_disconnect(dpy);
+	free(ewmh);
+	return EXIT_SUCCESS;
+}
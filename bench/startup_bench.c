@@ -0,0 +1,484 @@
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <xcb/xcb.h>
+
+/**
+ * @file startup_bench.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Measure how long howm takes to start, broken down into phases.
+ *
+ * An Xvfb server is started and a set of windows is mapped on it, then howm is
+ * started repeatedly with a config file that applies a fixed amount of
+ * settings. howm records when each phase of its startup ends, which is read
+ * back with the startup query once every setting has been applied.
+ *
+ * The config file calls this benchmark with -C, which sends a single setting
+ * over a new connection in the same way as cottage does.
+ *
+ * Each line of output holds a phase's name and amount of samples, followed by
+ * its minimum, median and maximum in microseconds. exec is the time from
+ * forking howm until it reached main(), first_event is the time from running
+ * the config file until howm handled its first X event or IPC message and
+ * total is the time from forking howm until the last setting was applied.
+ */
+
+/** How long to wait for Xvfb to start, or for howm to apply its config. */
+#define TIMEOUT_MS 10000
+/** The most startup marks that are read back from howm. */
+#define MAX_MARKS 16
+
+struct samples {
+	char name[32];
+	double v[256]; /**< Durations in microseconds. */
+	size_t n;
+};
+
+static const char *settings[][2] = {
+	{ "border_px", "2" },
+	{ "float_spawn_height", "400" },
+	{ "float_spawn_width", "600" },
+	{ "scratchpad_height", "400" },
+	{ "scratchpad_width", "600" },
+	{ "op_gap_size", "4" },
+	{ "bar_height", "20" },
+	{ "focus_mouse", "false" },
+	{ "focus_mouse_click", "true" },
+	{ "follow_move", "true" },
+	{ "zoom_gap", "true" },
+	{ "center_floating", "true" },
+	{ "bar_bottom", "true" },
+	{ "border_focus", "#70898F" },
+	{ "border_unfocus", "#555555" },
+	{ "border_prev_focus", "#74718E" },
+	{ "border_urgent", "#FF0000" },
+};
+
+static xcb_connection_t *dpy;
+static const char *sock_path = "/tmp/howm";
+static pid_t xvfb_pid, howm_pid;
+static struct samples phases[MAX_MARKS + 3];
+static unsigned int nphases;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_ms(long ms)
+{
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+
+	nanosleep(&ts, NULL);
+}
+
+static pid_t start(char *const argv[])
+{
+	pid_t pid = fork();
+
+	if (pid == -1) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	} else if (pid == 0) {
+		execvp(argv[0], argv);
+		perror(argv[0]);
+		_exit(EXIT_FAILURE);
+	}
+	return pid;
+}
+
+static void stop(pid_t pid)
+{
+	if (pid <= 0)
+		return;
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+}
+
+static void stop_all(void)
+{
+	if (dpy)
+		xcb_disconnect(dpy);
+	dpy = NULL;
+	stop(howm_pid);
+	stop(xvfb_pid);
+	howm_pid = xvfb_pid = 0;
+}
+
+static void fail(const char *msg)
+{
+	fprintf(stderr, "%s\n", msg);
+	stop_all();
+	exit(EXIT_FAILURE);
+}
+
+static int connect_howm(void)
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd == -1)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock_path);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static bool read_all(int fd, char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = read(fd, buf, len);
+		if (n <= 0)
+			return false;
+		buf += n;
+		len -= n;
+	}
+	return true;
+}
+
+/**
+ * @brief Send a text message made of type followed by each of the NULL
+ * terminated args.
+ *
+ * @return The connection, on which the reply can be read, or -1.
+ */
+static int send_msg(char type, const char *args[], unsigned int nargs)
+{
+	char msg[256];
+	int len = 2, fd = connect_howm();
+	unsigned int i;
+
+	if (fd == -1)
+		return -1;
+	msg[0] = type;
+	msg[1] = '\0';
+	for (i = 0; i < nargs; i++)
+		len += snprintf(msg + len, sizeof(msg) - len, "%s", args[i]) + 1;
+	if (write(fd, msg, len) != len) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * @brief Apply a single setting, as the config file does.
+ */
+static int send_setting(const char *key, const char *value)
+{
+	const char *args[] = { key, value };
+	int ret, fd = send_msg(2, args, 2); /* MSG_CONFIG */
+
+	if (fd == -1 || !read_all(fd, (char *)&ret, sizeof(ret))) {
+		perror("config");
+		return EXIT_FAILURE;
+	}
+	close(fd);
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Run the startup query.
+ *
+ * @return The JSON reply, which must be freed, or NULL.
+ */
+static char *query_startup(void)
+{
+	const char *args[] = { "startup" };
+	int err, fd = send_msg(4, args, 1); /* MSG_QUERY */
+	uint32_t len;
+	char *json = NULL;
+
+	if (fd == -1)
+		return NULL;
+	if (read_all(fd, (char *)&err, sizeof(err)) && err == 0
+			&& read_all(fd, (char *)&len, sizeof(len))
+			&& (json = calloc(len + 1, 1))
+			&& !read_all(fd, json, len)) {
+		free(json);
+		json = NULL;
+	}
+	close(fd);
+	return json;
+}
+
+static struct samples *phase(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < nphases; i++)
+		if (strcmp(phases[i].name, name) == 0)
+			return &phases[i];
+	if (nphases == sizeof(phases) / sizeof(phases[0]))
+		return NULL;
+	snprintf(phases[nphases].name, sizeof(phases[nphases].name), "%s", name);
+	return &phases[nphases++];
+}
+
+static void add_sample(const char *name, double us)
+{
+	struct samples *s = phase(name);
+
+	if (s && s->n < sizeof(s->v) / sizeof(s->v[0]))
+		s->v[s->n++] = us;
+}
+
+/**
+ * @brief Find the unsigned number that follows key in json, starting at p.
+ *
+ * @return A pointer to just after the number, or NULL if key isn't found.
+ */
+static const char *json_uint(const char *p, const char *key, unsigned long long *v)
+{
+	p = strstr(p, key);
+	if (!p)
+		return NULL;
+	p += strlen(key);
+	*v = strtoull(p, (char **)&p, 10);
+	return p;
+}
+
+/**
+ * @brief Record the phases from a startup query reply.
+ *
+ * @param json The reply.
+ * @param t0 When howm was forked, from now().
+ */
+static void record(const char *json, double t0)
+{
+	unsigned long long ns, us, exec_ns = 0;
+	const char *p = json, *name;
+	char buf[32];
+	size_t len;
+
+	while ((p = strstr(p, "{\"name\":\""))) {
+		name = p + strlen("{\"name\":\"");
+		len = strcspn(name, "\"");
+		snprintf(buf, sizeof(buf), "%.*s", (int)len, name);
+		if (!(p = json_uint(name, "\"ns\":", &ns))
+				|| !(p = json_uint(p, "\"phase_us\":", &us)))
+			break;
+		if (strcmp(buf, "main") == 0) {
+			add_sample("exec", ns / 1e3 - t0 * 1e6);
+		} else if (strcmp(buf, "first_event") == 0) {
+			if (exec_ns)
+				add_sample(buf, (ns - exec_ns) / 1e3);
+		} else {
+			add_sample(buf, us);
+		}
+		if (strcmp(buf, "exec_config") == 0)
+			exec_ns = ns;
+		else if (strcmp(buf, "last_config") == 0)
+			add_sample("total", ns / 1e3 - t0 * 1e6);
+	}
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void report(struct samples *s)
+{
+	qsort(s->v, s->n, sizeof(double), cmp_double);
+	printf("%s %zu %.0f %.0f %.0f\n", s->name, s->n, s->v[0],
+			s->v[s->n / 2], s->v[s->n - 1]);
+}
+
+/**
+ * @brief Write a config file that applies n settings, each by running this
+ * benchmark with -C.
+ */
+static void write_config(const char *path, const char *self, unsigned int n)
+{
+	FILE *f = fopen(path, "w");
+	unsigned int i, k;
+
+	if (!f)
+		fail("Can't write the config file");
+	fprintf(f, "#!/bin/sh\n");
+	for (i = 0; i < n; i++) {
+		k = i % (sizeof(settings) / sizeof(settings[0]));
+		fprintf(f, "'%s' -s '%s' -C '%s' '%s'\n", self, sock_path,
+				settings[k][0], settings[k][1]);
+	}
+	fclose(f);
+	chmod(path, 0755);
+}
+
+static void start_xvfb(char *xvfb, char *display, unsigned int nwins)
+{
+	char *xvfb_argv[] = { xvfb, display, "-screen", "0", "1920x1080x24",
+		"-nolisten", "tcp", NULL };
+	double deadline = now() + TIMEOUT_MS / 1000.0;
+	xcb_screen_t *screen;
+	xcb_window_t win;
+	unsigned int i;
+
+	xvfb_pid = start(xvfb_argv);
+	do {
+		if (dpy)
+			xcb_disconnect(dpy);
+		sleep_ms(10);
+		dpy = xcb_connect(display, NULL);
+	} while (xcb_connection_has_error(dpy) && now() < deadline);
+	if (xcb_connection_has_error(dpy))
+		fail("Couldn't connect to Xvfb");
+	screen = xcb_setup_roots_iterator(xcb_get_setup(dpy)).data;
+
+	/* Windows that exist before howm starts, as they would after a restart. */
+	for (i = 0; i < nwins; i++) {
+		win = xcb_generate_id(dpy);
+		xcb_create_window(dpy, XCB_COPY_FROM_PARENT, win, screen->root,
+				(i * 40) % 1000, (i * 30) % 600, 300, 200, 0,
+				XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual, 0, NULL);
+		xcb_map_window(dpy, win);
+	}
+	xcb_flush(dpy);
+	setenv("DISPLAY", display, 1);
+}
+
+/**
+ * @brief Start howm, wait for its config to be applied and record how long
+ * each phase took.
+ */
+static void run(char *howm, char *config, unsigned int nsettings)
+{
+	char *howm_argv[] = { howm, "-c", config, NULL };
+	double t0, deadline;
+	unsigned long long cnt = 0;
+	char *json = NULL;
+
+	unlink(sock_path);
+	t0 = now();
+	howm_pid = start(howm_argv);
+	deadline = t0 + TIMEOUT_MS / 1000.0;
+	while (now() < deadline) {
+		free(json);
+		json = query_startup();
+		if (json && json_uint(json, "\"config_messages\":", &cnt) && cnt >= nsettings)
+			break;
+		sleep_ms(5);
+	}
+	if (cnt < nsettings) {
+		free(json);
+		fail("howm didn't apply its config in time");
+	}
+	record(json, t0);
+	free(json);
+	stop(howm_pid);
+	howm_pid = 0;
+}
+
+int main(int argc, char *argv[])
+{
+	char *xvfb = "Xvfb", *display = ":99", *howm = "./howm";
+	char config[] = "/tmp/howm-startup-bench.XXXXXX";
+	char self[2 * PATH_MAX], cwd[PATH_MAX];
+	unsigned int nsettings = 50, nwins = 20, runs = 20, i;
+	bool send = false;
+	int ch, fd;
+
+	while ((ch = getopt(argc, argv, "X:d:w:s:n:W:r:C")) != -1) {
+		switch (ch) {
+		case 'X':
+			xvfb = optarg;
+			break;
+		case 'd':
+			display = optarg;
+			break;
+		case 'w':
+			howm = optarg;
+			break;
+		case 's':
+			sock_path = optarg;
+			break;
+		case 'n':
+			nsettings = strtoul(optarg, NULL, 10);
+			break;
+		case 'W':
+			nwins = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			runs = strtoul(optarg, NULL, 10);
+			break;
+		case 'C':
+			send = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-X Xvfb] [-d display] [-w howm] [-s socket]\n"
+					"\t[-n settings] [-W windows] [-r runs]\n"
+					"       %s [-s socket] -C key value\n",
+					argv[0], argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (send) {
+		if (argc - optind != 2) {
+			fprintf(stderr, "-C needs a key and a value\n");
+			return EXIT_FAILURE;
+		}
+		return send_setting(argv[optind], argv[optind + 1]);
+	}
+	if (!runs || runs > sizeof(phases[0].v) / sizeof(phases[0].v[0])) {
+		fprintf(stderr, "The amount of runs must be between 1 and %zu\n",
+				sizeof(phases[0].v) / sizeof(phases[0].v[0]));
+		return EXIT_FAILURE;
+	}
+	/* The config file is run by howm, so it needs an absolute path to us. */
+	if (argv[0][0] == '/') {
+		snprintf(self, sizeof(self), "%s", argv[0]);
+	} else if (getcwd(cwd, sizeof(cwd))) {
+		snprintf(self, sizeof(self), "%s/%s", cwd, argv[0]);
+	} else {
+		perror("getcwd");
+		return EXIT_FAILURE;
+	}
+	fd = mkstemp(config);
+	if (fd == -1) {
+		perror("mkstemp");
+		return EXIT_FAILURE;
+	}
+	close(fd);
+	write_config(config, self, nsettings);
+
+	start_xvfb(xvfb, display, nwins);
+	for (i = 0; i < runs; i++)
+		run(howm, config, nsettings);
+	stop_all();
+	unlink(config);
+
+	printf("# settings %u windows %u runs %u\n", nsettings, nwins, runs);
+	printf("# phase samples min_us p50_us max_us\n");
+	for (i = 0; i < nphases; i++)
+		report(&phases[i]);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,556 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <xcb/xcb.h>
+
+/**
+ * @file workload.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Generate a synthetic workload of X clients for howm to manage.
+ *
+ * A set of windows is mapped, then actions are performed at a fixed rate,
+ * chosen at random according to their weights:
+ *
+ * configure: A window asks to be resized, as terminals do.
+ * property: A window changes its title.
+ * urgent: A window toggles its urgency hint.
+ * transient: A short lived transient window is mapped.
+ * dialog: A short lived dialog is mapped.
+ * fullscreen: A window asks to toggle fullscreen through _NET_WM_STATE.
+ * notify: A notification window is mapped or unmapped.
+ * churn: A window is destroyed and replaced with a new one.
+ *
+ * Everything is done with plain XCB requests, in the same way as real
+ * clients do, so that the code paths in handler.c are driven at a controlled
+ * rate. The amount of each action performed is printed on exit.
+ *
+ * In soak mode, howm's memory query is run periodically. Once every window
+ * has been destroyed, howm must have freed every client that it allocated for
+ * them and its resident set size must not have grown by more than a tolerance
+ * since the first sample, otherwise the run fails.
+ */
+
+/** The most short lived windows that can exist at once. */
+#define MAX_TEMP 64
+/** How long short lived windows exist for, in ticks. */
+#define TEMP_TICKS 20
+/** The urgency flag in WM_HINTS. */
+#define URGENCY_HINT (1 << 8)
+/** The amount of CARD32s in WM_HINTS. */
+#define WM_HINTS_LEN 9
+/** How long howm is given to handle the last windows being destroyed. */
+#define SETTLE_MS 1000
+
+enum actions { ACT_CONFIGURE, ACT_PROPERTY, ACT_URGENT, ACT_TRANSIENT,
+	ACT_DIALOG, ACT_FULLSCREEN, ACT_NOTIFY, ACT_CHURN, ACT_END };
+
+static struct {
+	const char *name;
+	unsigned int weight;
+	unsigned long done;
+} actions[ACT_END] = {
+	[ACT_CONFIGURE] = { "configure", 40, 0 },
+	[ACT_PROPERTY] = { "property", 30, 0 },
+	[ACT_URGENT] = { "urgent", 5, 0 },
+	[ACT_TRANSIENT] = { "transient", 5, 0 },
+	[ACT_DIALOG] = { "dialog", 5, 0 },
+	[ACT_FULLSCREEN] = { "fullscreen", 5, 0 },
+	[ACT_NOTIFY] = { "notify", 10, 0 },
+	[ACT_CHURN] = { "churn", 5, 0 },
+};
+
+/**
+ * @brief A sample of howm's memory query.
+ */
+struct mem_sample {
+	unsigned long clients; /**< Clients that howm has allocated. */
+	unsigned long reachable; /**< Clients that howm can still reach. */
+	unsigned long rss_kb;
+};
+
+enum atoms { NET_WM_NAME, NET_WM_STATE, NET_WM_STATE_FULLSCREEN,
+	NET_WM_WINDOW_TYPE, NET_WM_WINDOW_TYPE_DIALOG,
+	NET_WM_WINDOW_TYPE_NOTIFICATION, UTF8_STRING, ATOMS_END };
+
+static const char *atom_names[ATOMS_END] = {
+	[NET_WM_NAME] = "_NET_WM_NAME",
+	[NET_WM_STATE] = "_NET_WM_STATE",
+	[NET_WM_STATE_FULLSCREEN] = "_NET_WM_STATE_FULLSCREEN",
+	[NET_WM_WINDOW_TYPE] = "_NET_WM_WINDOW_TYPE",
+	[NET_WM_WINDOW_TYPE_DIALOG] = "_NET_WM_WINDOW_TYPE_DIALOG",
+	[NET_WM_WINDOW_TYPE_NOTIFICATION] = "_NET_WM_WINDOW_TYPE_NOTIFICATION",
+	[UTF8_STRING] = "UTF8_STRING",
+};
+
+struct temp_win {
+	xcb_window_t win;
+	unsigned long expires; /**< The tick that the window is destroyed on. */
+};
+
+static xcb_connection_t *dpy;
+static xcb_screen_t *screen;
+static xcb_atom_t atoms[ATOMS_END];
+static xcb_window_t *wins;
+static bool *urgent;
+static unsigned int nwins;
+static struct temp_win temps[MAX_TEMP];
+static xcb_window_t notify_win;
+static bool notify_mapped;
+static uint32_t rng = 2463534242u;
+static const char *sock_path = "/tmp/howm";
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** A xorshift generator, so that runs can be repeated with the same seed. */
+static uint32_t rnd(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+static void sleep_until(double t)
+{
+	double left = t - now();
+	struct timespec ts;
+
+	if (left <= 0)
+		return;
+	ts.tv_sec = (time_t)left;
+	ts.tv_nsec = (long)((left - ts.tv_sec) * 1e9);
+	nanosleep(&ts, NULL);
+}
+
+static void intern_atoms(void)
+{
+	xcb_intern_atom_cookie_t cookies[ATOMS_END];
+	xcb_intern_atom_reply_t *r;
+	unsigned int i;
+
+	for (i = 0; i < ATOMS_END; i++)
+		cookies[i] = xcb_intern_atom(dpy, 0, strlen(atom_names[i]), atom_names[i]);
+	for (i = 0; i < ATOMS_END; i++) {
+		r = xcb_intern_atom_reply(dpy, cookies[i], NULL);
+		atoms[i] = r ? r->atom : XCB_NONE;
+		free(r);
+	}
+}
+
+static void set_title(xcb_window_t win, const char *title)
+{
+	xcb_change_property(dpy, XCB_PROP_MODE_REPLACE, win, XCB_ATOM_WM_NAME,
+			XCB_ATOM_STRING, 8, strlen(title), title);
+	xcb_change_property(dpy, XCB_PROP_MODE_REPLACE, win, atoms[NET_WM_NAME],
+			atoms[UTF8_STRING], 8, strlen(title), title);
+}
+
+static xcb_window_t create_window(xcb_atom_t type)
+{
+	xcb_window_t win = xcb_generate_id(dpy);
+
+	xcb_create_window(dpy, XCB_COPY_FROM_PARENT, win, screen->root, 0, 0,
+			200 + rnd() % 400, 100 + rnd() % 300, 0,
+			XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual, 0, NULL);
+	if (type != XCB_NONE)
+		xcb_change_property(dpy, XCB_PROP_MODE_REPLACE, win,
+				atoms[NET_WM_WINDOW_TYPE], XCB_ATOM_ATOM, 32, 1, &type);
+	set_title(win, "workload");
+	return win;
+}
+
+/**
+ * @brief Map a window that will be destroyed after TEMP_TICKS.
+ *
+ * @return False if there are already too many short lived windows.
+ */
+static bool map_temp(xcb_window_t win, unsigned long tick)
+{
+	unsigned int i;
+
+	for (i = 0; i < MAX_TEMP; i++) {
+		if (temps[i].win == XCB_NONE) {
+			temps[i].win = win;
+			temps[i].expires = tick + TEMP_TICKS;
+			xcb_map_window(dpy, win);
+			return true;
+		}
+	}
+	xcb_destroy_window(dpy, win);
+	return false;
+}
+
+static void expire_temps(unsigned long tick, bool all)
+{
+	unsigned int i;
+
+	for (i = 0; i < MAX_TEMP; i++) {
+		if (temps[i].win != XCB_NONE && (all || temps[i].expires <= tick)) {
+			xcb_destroy_window(dpy, temps[i].win);
+			temps[i].win = XCB_NONE;
+		}
+	}
+}
+
+static void toggle_urgent(unsigned int i)
+{
+	uint32_t hints[WM_HINTS_LEN] = { 0 };
+
+	urgent[i] = !urgent[i];
+	hints[0] = urgent[i] ? URGENCY_HINT : 0;
+	xcb_change_property(dpy, XCB_PROP_MODE_REPLACE, wins[i], XCB_ATOM_WM_HINTS,
+			XCB_ATOM_WM_HINTS, 32, WM_HINTS_LEN, hints);
+}
+
+static void toggle_fullscreen(xcb_window_t win)
+{
+	xcb_client_message_event_t ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.response_type = XCB_CLIENT_MESSAGE;
+	ev.format = 32;
+	ev.window = win;
+	ev.type = atoms[NET_WM_STATE];
+	ev.data.data32[0] = 2; /* _NET_WM_STATE_TOGGLE */
+	ev.data.data32[1] = atoms[NET_WM_STATE_FULLSCREEN];
+	ev.data.data32[3] = 1; /* Sent by a normal application. */
+	xcb_send_event(dpy, 0, screen->root, XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT
+			| XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, (const char *)&ev);
+}
+
+static void perform(enum actions act, unsigned long tick)
+{
+	unsigned int i = rnd() % nwins;
+	uint32_t vals[2];
+	xcb_window_t win;
+	char title[64];
+
+	switch (act) {
+	case ACT_CONFIGURE:
+		vals[0] = 200 + rnd() % 800;
+		vals[1] = 100 + rnd() % 600;
+		xcb_configure_window(dpy, wins[i], XCB_CONFIG_WINDOW_WIDTH
+				| XCB_CONFIG_WINDOW_HEIGHT, vals);
+		break;
+	case ACT_PROPERTY:
+		snprintf(title, sizeof(title), "workload %u: %lu", i, tick);
+		set_title(wins[i], title);
+		break;
+	case ACT_URGENT:
+		toggle_urgent(i);
+		break;
+	case ACT_TRANSIENT:
+		win = create_window(XCB_NONE);
+		xcb_change_property(dpy, XCB_PROP_MODE_REPLACE, win,
+				XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 32, 1, &wins[i]);
+		map_temp(win, tick);
+		break;
+	case ACT_DIALOG:
+		map_temp(create_window(atoms[NET_WM_WINDOW_TYPE_DIALOG]), tick);
+		break;
+	case ACT_FULLSCREEN:
+		toggle_fullscreen(wins[i]);
+		break;
+	case ACT_CHURN:
+		xcb_destroy_window(dpy, wins[i]);
+		wins[i] = create_window(XCB_NONE);
+		urgent[i] = false;
+		xcb_map_window(dpy, wins[i]);
+		break;
+	case ACT_NOTIFY:
+		if (notify_mapped)
+			xcb_unmap_window(dpy, notify_win);
+		else
+			xcb_map_window(dpy, notify_win);
+		notify_mapped = !notify_mapped;
+		break;
+	default:
+		return;
+	}
+	actions[act].done++;
+}
+
+static enum actions pick(unsigned int total)
+{
+	unsigned int r = rnd() % total, i;
+
+	for (i = 0; i < ACT_END; i++) {
+		if (r < actions[i].weight)
+			return i;
+		r -= actions[i].weight;
+	}
+	return ACT_CONFIGURE;
+}
+
+/**
+ * @brief Parse weights such as "configure=10,notify=0". Actions that aren't
+ * mentioned keep their default weight.
+ */
+static bool parse_weights(char *arg)
+{
+	char *tok, *eq;
+	unsigned int i;
+
+	for (tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+		eq = strchr(tok, '=');
+		if (!eq)
+			return false;
+		*eq = '\0';
+		for (i = 0; i < ACT_END; i++)
+			if (strcmp(tok, actions[i].name) == 0)
+				break;
+		if (i == ACT_END)
+			return false;
+		actions[i].weight = strtoul(eq + 1, NULL, 10);
+	}
+	return true;
+}
+
+static void drain_events(void)
+{
+	xcb_generic_event_t *ev;
+
+	while ((ev = xcb_poll_for_event(dpy)))
+		free(ev);
+}
+
+static unsigned long json_ulong(const char *json, const char *key)
+{
+	const char *p = strstr(json, key);
+
+	return p ? strtoul(p + strlen(key), NULL, 10) : 0;
+}
+
+/**
+ * @brief Run howm's memory query.
+ *
+ * @return False if howm couldn't be asked.
+ */
+static bool sample_memory(struct mem_sample *m)
+{
+	/* MSG_QUERY followed by the name of the query. */
+	static const char msg[] = "\4\0memory";
+	struct sockaddr_un addr;
+	char json[1024];
+	uint32_t len;
+	ssize_t n;
+	size_t got = 0;
+	int err, fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd == -1)
+		return false;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock_path);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+			|| write(fd, msg, sizeof(msg)) != sizeof(msg)
+			|| read(fd, &err, sizeof(err)) != sizeof(err) || err != 0
+			|| read(fd, &len, sizeof(len)) != sizeof(len)
+			|| len >= sizeof(json)) {
+		close(fd);
+		return false;
+	}
+	while (got < len && (n = read(fd, json + got, len - got)) > 0)
+		got += n;
+	close(fd);
+	if (got < len)
+		return false;
+	json[len] = '\0';
+
+	m->clients = json_ulong(json, "\"clients\":{\"live\":");
+	m->reachable = json_ulong(json, "\"clients_reachable\":");
+	m->rss_kb = json_ulong(json, "\"rss_kb\":");
+	return true;
+}
+
+static bool soak_sample(struct mem_sample *m, double t)
+{
+	if (!sample_memory(m)) {
+		fprintf(stderr, "Can't run howm's memory query on %s\n", sock_path);
+		return false;
+	}
+	printf("soak %.0f %lu %lu %lu\n", t, m->clients, m->reachable,
+			m->rss_kb);
+	fflush(stdout);
+	return true;
+}
+
+/**
+ * @brief Check that howm has gone back to the memory footprint that it had
+ * before the workload started.
+ *
+ * @param before Sampled before any windows were mapped.
+ * @param first The first sample taken under load, once howm had warmed up.
+ * @param after Sampled once every window had been destroyed.
+ * @param tolerance_kb How much the resident set size may grow.
+ */
+static bool soak_check(const struct mem_sample *before,
+		const struct mem_sample *first, const struct mem_sample *after,
+		unsigned long tolerance_kb)
+{
+	bool ok = true;
+
+	if (after->clients != before->clients) {
+		fprintf(stderr, "soak: %lu clients allocated, %lu before the workload\n",
+				after->clients, before->clients);
+		ok = false;
+	}
+	if (after->clients != after->reachable) {
+		fprintf(stderr, "soak: %lu clients allocated but only %lu reachable\n",
+				after->clients, after->reachable);
+		ok = false;
+	}
+	if (after->rss_kb > first->rss_kb + tolerance_kb) {
+		fprintf(stderr, "soak: RSS grew from %lu KiB to %lu KiB\n",
+				first->rss_kb, after->rss_kb);
+		ok = false;
+	}
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int rate = 100, total = 0, i;
+	double duration = 10, soak = 0, start, next, next_soak;
+	unsigned long tick, tolerance_kb = 1024;
+	struct mem_sample before, first, after;
+	bool sampled = false, ok = true;
+	char *display = NULL;
+	int ch;
+
+	nwins = 20;
+	while ((ch = getopt(argc, argv, "d:n:r:t:w:s:S:m:g:")) != -1) {
+		switch (ch) {
+		case 'd':
+			display = optarg;
+			break;
+		case 'n':
+			nwins = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			rate = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			duration = strtod(optarg, NULL);
+			break;
+		case 'w':
+			if (!parse_weights(optarg)) {
+				fprintf(stderr, "Bad weights: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 's':
+			rng = strtoul(optarg, NULL, 10) | 1;
+			break;
+		case 'S':
+			sock_path = optarg;
+			break;
+		case 'm':
+			soak = strtod(optarg, NULL);
+			break;
+		case 'g':
+			tolerance_kb = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-d display] [-n windows] [-r actions/s]\n"
+					"\t[-t seconds, 0 for ever] [-w action=weight,...] [-s seed]\n"
+					"\t[-m soak sample seconds] [-g soak RSS tolerance KiB] [-S socket]\n",
+					argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	for (i = 0; i < ACT_END; i++)
+		total += actions[i].weight;
+	if (!nwins || !rate || !total) {
+		fprintf(stderr, "The windows, rate and weights must be non-zero\n");
+		return EXIT_FAILURE;
+	}
+
+	dpy = xcb_connect(display, NULL);
+	if (xcb_connection_has_error(dpy)) {
+		fprintf(stderr, "Can't open X connection\n");
+		return EXIT_FAILURE;
+	}
+	screen = xcb_setup_roots_iterator(xcb_get_setup(dpy)).data;
+	intern_atoms();
+
+	if (soak > 0) {
+		printf("# soak seconds clients reachable rss_kb\n");
+		if (!soak_sample(&before, 0))
+			return EXIT_FAILURE;
+	}
+
+	wins = calloc(nwins, sizeof(xcb_window_t));
+	urgent = calloc(nwins, sizeof(bool));
+	if (!wins || !urgent) {
+		perror("calloc");
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < nwins; i++) {
+		wins[i] = create_window(XCB_NONE);
+		xcb_map_window(dpy, wins[i]);
+	}
+	notify_win = create_window(atoms[NET_WM_WINDOW_TYPE_NOTIFICATION]);
+	xcb_flush(dpy);
+
+	start = next = now();
+	next_soak = start + soak;
+	for (tick = 0; duration <= 0 || now() - start < duration; tick++) {
+		perform(pick(total), tick);
+		expire_temps(tick, false);
+		xcb_flush(dpy);
+		drain_events();
+		if (xcb_connection_has_error(dpy)) {
+			fprintf(stderr, "Lost the X connection\n");
+			return EXIT_FAILURE;
+		}
+		if (soak > 0 && now() >= next_soak) {
+			if (!soak_sample(sampled ? &after : &first, now() - start))
+				return EXIT_FAILURE;
+			sampled = true;
+			next_soak += soak;
+		}
+		next += 1.0 / rate;
+		sleep_until(next);
+	}
+
+	expire_temps(tick, true);
+	for (i = 0; i < nwins; i++)
+		xcb_destroy_window(dpy, wins[i]);
+	xcb_destroy_window(dpy, notify_win);
+	xcb_flush(dpy);
+
+	if (soak > 0) {
+		sleep_until(now() + SETTLE_MS / 1000.0);
+		if (!soak_sample(&after, now() - start))
+			return EXIT_FAILURE;
+		ok = soak_check(&before, sampled ? &first : &before, &after, tolerance_kb);
+	}
+
+	printf("# action weight performed\n");
+	for (i = 0; i < ACT_END; i++)
+		printf("%s %u %lu\n", actions[i].name, actions[i].weight, actions[i].done);
+	printf("# %lu actions in %.1f s\n", tick, now() - start);
+
+	xcb_disconnect(dpy);
+	free(wins);
+	free(urgent);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
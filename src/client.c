@@ -11,6 +11,9 @@
 #include "howm.h"
 #include "xcb_help.h"
 #include "scratchpad.h"
+#include "xstats.h"
+#include "mem.h"
+#include "probes.h"
 
 /**
  * @file client.c
@@ -104,6 +107,7 @@ void update_focused_client(Client *c)
 	if (!c)
 		return;
 
+	PROBE3(focus, cw, wss[cw].client_cnt, c->win);
 	if (!wss[cw].head) {
 		wss[cw].prev_foc = wss[cw].current = NULL;
 		xcb_ewmh_set_active_window(ewmh, 0, XCB_NONE);
@@ -114,6 +118,8 @@ void update_focused_client(Client *c)
 		wss[cw].prev_foc = wss[cw].current;
 		wss[cw].current = c;
 	}
+	if (arrange_deferred(REDRAW_FOCUS))
+		return;
 
 	log_info("Focusing client <%p>", c);
 	for (c = wss[cw].head; c; c = c->next, ++all) {
@@ -199,6 +205,7 @@ void remove_client(Client *c, bool refocus)
 	return;
 
 found:
+	PROBE3(client_remove, w, wss[w].client_cnt, c->win);
 	*temp = c->next;
 	log_info("Removing client <%p>", c);
 	if (c == wss[w].prev_foc)
@@ -209,6 +216,7 @@ found:
 			update_focused_client(wss[w].current);
 	}
 	free(c);
+	mem_free(MEM_CLIENTS);
 	c = NULL;
 	wss[w].client_cnt--;
 }
@@ -294,6 +302,24 @@ void focus_prev_client(void)
 	update_focused_client(prev_client(wss[cw].prev_foc, cw));
 }
 
+/**
+ * @brief Ask a client to close, or kill it if it doesn't support
+ * WM_DELETE_WINDOW.
+ *
+ * The client's WM_PROTOCOLS are fetched when it is mapped, so this never
+ * waits for the X server and closing many clients is a single burst of
+ * requests.
+ *
+ * @param c The client to close.
+ */
+void close_client(Client *c)
+{
+	if (c->protocols & WM_PROTO_DELETE_WINDOW)
+		delete_win(c->win);
+	else
+		xcb_kill_client(dpy, c->win);
+}
+
 /**
  * @brief Kills the current client on the workspace ws.
  *
@@ -303,27 +329,10 @@ void focus_prev_client(void)
  */
 void kill_client(const int ws, bool arrange)
 {
-	xcb_icccm_get_wm_protocols_reply_t rep;
-	unsigned int i;
-	bool found = false;
-
 	if (!wss[ws].current)
 		return;
 
-	if (xcb_icccm_get_wm_protocols_reply(dpy,
-				xcb_icccm_get_wm_protocols(dpy,
-					wss[ws].current->win,
-					wm_atoms[WM_PROTOCOLS]), &rep, NULL)) {
-		for (i = 0; i < rep.atoms_len; ++i)
-			if (rep.atoms[i] == wm_atoms[WM_DELETE_WINDOW]) {
-				delete_win(wss[ws].current->win);
-				found = true;
-				break;
-			}
-		xcb_icccm_get_wm_protocols_reply_wipe(&rep);
-	}
-	if (!found)
-		xcb_kill_client(dpy, wss[ws].current->win);
+	close_client(wss[ws].current);
 	log_info("Killing Client <%p>", wss[ws].current);
 	remove_client(wss[ws].current, arrange);
 }
@@ -438,7 +447,10 @@ void draw_clients(void)
 {
 	Client *c = NULL;
 
+	if (arrange_deferred(REDRAW_DRAW))
+		return;
 	log_debug("Drawing clients");
+	PROBE2(draw_start, cw, wss[cw].client_cnt);
 	for (c = wss[cw].head; c; c = c->next)
 		if (wss[cw].layout == ZOOM && conf.zoom_gap && !c->is_floating) {
 			set_border_width(c->win, 0);
@@ -456,6 +468,7 @@ void draw_clients(void)
 					c->w - (2 * (c->gap + conf.border_px)),
 					c->h - (2 * (c->gap + conf.border_px)));
 		}
+	PROBE2(draw_done, cw, wss[cw].client_cnt);
 }
 
 /**
@@ -480,6 +493,9 @@ void change_client_geom(Client *c, uint16_t x, uint16_t y, uint16_t w, uint16_t
 /**
  * @brief A helper function to change the size of a client's gaps.
  *
+ * The clients aren't redrawn, so that changing the gaps of many clients only
+ * redraws them once.
+ *
  * @param c The client who's gap size should be changed.
  * @param size The size by which the gap should be changed.
  */
@@ -495,21 +511,21 @@ void change_client_gaps(Client *c, int size)
 	uint32_t space = c->gap + conf.border_px;
 
 	xcb_ewmh_set_frame_extents(ewmh, c->win, space, space, space, space);
-	draw_clients();
 }
 
 /**
  * @brief Convert a window into a client.
  *
  * @param w A valid xcb window.
+ * @param ws The workspace that the client is added to.
  *
  * @return A client that has already been inserted into the linked list of
  * clients.
  */
-Client *create_client(xcb_window_t w)
+Client *create_client(xcb_window_t w, int ws)
 {
 	Client *c = (Client *)calloc(1, sizeof(Client));
-	Client *t = prev_client(wss[cw].head, cw); /* Get the last element. */
+	Client *t = prev_client(wss[ws].head, ws); /* Get the last element. */
 	uint32_t vals[1] = { XCB_EVENT_MASK_PROPERTY_CHANGE |
 				 (conf.focus_mouse ? XCB_EVENT_MASK_ENTER_WINDOW : 0)};
 
@@ -517,20 +533,22 @@ Client *create_client(xcb_window_t w)
 		log_err("Can't allocate memory for client.");
 		exit(EXIT_FAILURE);
 	}
-	if (!wss[cw].head)
-		wss[cw].head = c;
+	mem_alloc(MEM_CLIENTS);
+	if (!wss[ws].head)
+		wss[ws].head = c;
 	else if (t)
 		t->next = c;
 	else
-		wss[cw].head->next = c;
+		wss[ws].head->next = c;
 	c->win = w;
-	c->gap = wss[cw].gap;
+	c->gap = wss[ws].gap;
 	xcb_change_window_attributes(dpy, c->win, XCB_CW_EVENT_MASK, vals);
 	uint32_t space = c->gap + conf.border_px;
 
 	xcb_ewmh_set_frame_extents(ewmh, c->win, space, space, space, space);
 	log_info("Created client <%p>", c);
-	wss[cw].client_cnt++;
+	wss[ws].client_cnt++;
+	PROBE3(client_create, ws, wss[ws].client_cnt, w);
 	return c;
 }
 
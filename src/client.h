@@ -20,12 +20,13 @@ enum teleport_locations { TOP_LEFT, TOP_CENTER, TOP_RIGHT, CENTER, BOTTOM_LEFT,
 int get_non_tff_count(void);
 Client *get_first_non_tff(void);
 void change_client_gaps(Client *c, int size);
+void close_client(Client *c);
 void kill_client(const int ws, bool arrange);
 void move_up(Client *c);
 Client *next_client(Client *c);
 void update_focused_client(Client *c);
 Client *prev_client(Client *c, int ws);
-Client *create_client(xcb_window_t w);
+Client *create_client(xcb_window_t w, int ws);
 void remove_client(Client *c, bool refocus);
 Client *find_client_by_win(xcb_window_t w);
 void client_to_ws(Client *c, const int ws, bool follow);
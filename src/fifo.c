@@ -0,0 +1,162 @@
+#define _POSIX_C_SOURCE 200809L
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fifo.h"
+#include "howm.h"
+#include "helper.h"
+#include "ipc.h"
+
+/**
+ * @file fifo.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Read commands from a named pipe, one per line.
+ *
+ * Each line is a command and its args separated by whitespace, such as
+ * "change_ws 3", which is run in the same way as a function sent over IPC.
+ * A key daemon can write to the pipe without starting cottage or connecting
+ * to howm's socket. Nothing is sent back: failed commands are logged.
+ */
+
+static int fd = -1;
+static char buf[FIFO_BUF_SIZE];
+static size_t len;
+static bool discarding; /**< Is the rest of an over long line being skipped? */
+
+static void fifo_run_line(char *line);
+
+/**
+ * @brief Start reading commands from a FIFO, creating it if it doesn't exist.
+ * Any FIFO that was already open is closed.
+ *
+ * @param path The path of the FIFO, or an empty string to stop reading
+ * commands.
+ *
+ * @return An error code from ipc_errs.
+ */
+int fifo_open(const char *path)
+{
+	struct stat st;
+
+	fifo_cleanup();
+	if (path[0] == '\0')
+		return IPC_ERR_NONE;
+
+	if (mkfifo(path, 0600) == -1 && errno != EEXIST) {
+		log_err("Can't create the command FIFO %s", path);
+		return IPC_ERR_SYNTAX;
+	}
+	/* Opening for writing as well means that there is always a writer, so
+	 * the FIFO doesn't report EOF whenever the last real writer closes it. */
+	fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd == -1 || fstat(fd, &st) == -1 || !S_ISFIFO(st.st_mode)) {
+		log_err("Can't open the command FIFO %s", path);
+		fifo_cleanup();
+		return IPC_ERR_SYNTAX;
+	}
+	log_info("Reading commands from %s", path);
+	return IPC_ERR_NONE;
+}
+
+/**
+ * @brief Add the FIFO to a set of file descriptors.
+ *
+ * @param descs The set that will be passed to select.
+ * @param max_fd The current value of the highest fd plus one.
+ *
+ * @return The new value of the highest fd plus one.
+ */
+int fifo_set_fds(fd_set *descs, int max_fd)
+{
+	if (fd == -1)
+		return max_fd;
+	FD_SET(fd, descs);
+	return MAX_FD(fd, max_fd - 1);
+}
+
+/**
+ * @brief Run every complete line that can be read from the FIFO.
+ *
+ * @param descs The set of file descriptors returned by select.
+ */
+void fifo_handle_fds(fd_set *descs)
+{
+	char *line, *nl;
+	ssize_t n;
+
+	if (fd == -1 || !FD_ISSET(fd, descs))
+		return;
+
+	while ((n = read(fd, buf + len, sizeof(buf) - len)) > 0) {
+		len += n;
+		line = buf;
+		while ((nl = memchr(line, '\n', len - (line - buf)))) {
+			*nl = '\0';
+			if (!discarding)
+				fifo_run_line(line);
+			discarding = false;
+			line = nl + 1;
+		}
+		len -= line - buf;
+		memmove(buf, line, len);
+		if (len == sizeof(buf)) {
+			log_warn("Discarding a command longer than %d bytes", FIFO_BUF_SIZE);
+			discarding = true;
+			len = 0;
+		}
+	}
+	if (n == -1 && errno != EAGAIN && errno != EINTR) {
+		log_err("Failed to read from the command FIFO");
+		fifo_cleanup();
+	}
+}
+
+/**
+ * @brief Split a line into words and run it as a command.
+ *
+ * @param line A NULL terminated line, without its newline. It is modified.
+ */
+static void fifo_run_line(char *line)
+{
+	char *args[FIFO_MAX_ARGS + 1];
+	unsigned int argc = 0, opcode;
+	char *tok;
+	int err;
+
+	for (tok = strtok(line, " \t\r"); tok; tok = strtok(NULL, " \t\r")) {
+		if (argc == FIFO_MAX_ARGS) {
+			log_warn("Too many args in command %s", args[0]);
+			return;
+		}
+		args[argc++] = tok;
+	}
+	if (argc == 0 || args[0][0] == '#')
+		return;
+	args[argc] = NULL;
+
+	opcode = ipc_command_opcode(args[0]);
+	err = ipc_command_run(opcode, args + 1);
+	if (err != IPC_ERR_NONE)
+		log_warn("Command %s from the FIFO failed with error %d", args[0], err);
+}
+
+/**
+ * @brief Stop reading commands from the FIFO. The FIFO itself is left in
+ * place, as key daemons may still have it open.
+ */
+void fifo_cleanup(void)
+{
+	if (fd != -1)
+		close(fd);
+	fd = -1;
+	len = 0;
+	discarding = false;
+}
@@ -0,0 +1,27 @@
+#ifndef FIFO_H
+#define FIFO_H
+
+#include <sys/select.h>
+
+/**
+ * @file fifo.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/** The longest command that can be read from the FIFO, including its
+ * newline. */
+#define FIFO_BUF_SIZE 1024
+/** The most words that a command read from the FIFO can have. */
+#define FIFO_MAX_ARGS 16
+
+int fifo_open(const char *path);
+int fifo_set_fds(fd_set *descs, int max_fd);
+void fifo_handle_fds(fd_set *descs);
+void fifo_cleanup(void);
+
+#endif
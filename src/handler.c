@@ -12,6 +12,11 @@
 #include "workspace.h"
 #include "xcb_help.h"
 #include "layout.h"
+#include "xstats.h"
+#include "probes.h"
+#include "keys.h"
+#include "ipc.h"
+#include "xworker.h"
 
 /**
  * @file handler.c
@@ -31,6 +36,7 @@ static void map_event(xcb_generic_event_t *ev);
 static void configure_event(xcb_generic_event_t *ev);
 static void unmap_event(xcb_generic_event_t *ev);
 static void client_message_event(xcb_generic_event_t *ev);
+static void property_event(xcb_generic_event_t *ev);
 static void unhandled_event(xcb_generic_event_t *ev);
 
 /**
@@ -56,71 +62,66 @@ static void button_press_event(xcb_generic_event_t *ev)
 /**
  * @brief Handles mapping requests.
  *
- * When an X window wishes to be displayed, it send a mapping request. This
- * function processes that mapping request and inserts the new client (created
- * from the map requesting window) into the list of clients for the current
- * workspace.
+ * When an X window wishes to be displayed, it send a mapping request. The
+ * window's properties are fetched by the X worker, which then passes them to
+ * manage_window().
  *
  * @param ev A mapping request event.
  */
 static void map_event(xcb_generic_event_t *ev)
 {
-	xcb_window_t transient = 0;
-	xcb_get_geometry_reply_t *geom;
-	xcb_get_window_attributes_reply_t *wa;
 	xcb_map_request_event_t *me = (xcb_map_request_event_t *)ev;
-	xcb_ewmh_get_atoms_reply_t type;
-	unsigned int i;
-	Client *c;
 
-	wa = xcb_get_window_attributes_reply(dpy, xcb_get_window_attributes(dpy, me->window), NULL);
-	if (!wa || wa->override_redirect || find_client_by_win(me->window)) {
-		free(wa);
+	if (find_client_by_win(me->window))
 		return;
-	}
-	free(wa);
-
 	log_info("Mapping request for window <0x%x>", me->window);
+	xworker_manage(me->window);
+}
 
-	c = create_client(me->window);
-
-	if (xcb_ewmh_get_wm_window_type_reply(ewmh,
-				xcb_ewmh_get_wm_window_type(ewmh, me->window),
-				&type, NULL) == 1) {
-		for (i = 0; i < type.atoms_len; i++) {
-			xcb_atom_t a = type.atoms[i];
-
-			if (a == ewmh->_NET_WM_WINDOW_TYPE_DOCK
-				|| a == ewmh->_NET_WM_WINDOW_TYPE_TOOLBAR) {
-				return;
-			} else if (a == ewmh->_NET_WM_WINDOW_TYPE_NOTIFICATION
-				|| a == ewmh->_NET_WM_WINDOW_TYPE_DROPDOWN_MENU
-				|| a == ewmh->_NET_WM_WINDOW_TYPE_SPLASH
-				|| a == ewmh->_NET_WM_WINDOW_TYPE_POPUP_MENU
-				|| a == ewmh->_NET_WM_WINDOW_TYPE_TOOLTIP
-				|| a == ewmh->_NET_WM_WINDOW_TYPE_DIALOG) {
-				c->is_floating = true;
-			}
-		}
-	}
+/**
+ * @brief Start managing a window that has asked to be mapped.
+ *
+ * The new client (created from the map requesting window) is inserted into
+ * the list of clients for the workspace that was current when the window asked
+ * to be mapped. If the workspace has been changed whilst the window's
+ * properties were being fetched, the window stays unmapped until its workspace
+ * is shown again.
+ *
+ * @param j The properties of the window, fetched by the X worker.
+ */
+void manage_window(const struct xworker_job *j)
+{
+	Client *c;
 
+	if (!j->exists || j->override_redirect || find_client_by_win(j->win))
+		return;
+
+	c = create_client(j->win, j->ws);
+	c->protocols = j->protocols;
+	if (j->dock)
+		return;
+	c->is_floating = j->floating;
 
 	/* Assume that transient windows MUST float. */
-	xcb_icccm_get_wm_transient_for_reply(dpy, xcb_icccm_get_wm_transient_for_unchecked(dpy, me->window), &transient, NULL);
-	c->is_transient = transient ? true : false;
+	c->is_transient = j->transient;
 	if (c->is_transient)
 		c->is_floating = true;
 
-	geom = xcb_get_geometry_reply(dpy, xcb_get_geometry_unchecked(dpy, me->window), NULL);
-	if (geom) {
-		log_info("Mapped client's initial geom is %ux%u+%d+%d", geom->width, geom->height, geom->x, geom->y);
+	if (j->has_geom) {
+		log_info("Mapped client's initial geom is %ux%u+%d+%d", j->w, j->h, j->x, j->y);
 		if (c->is_floating) {
-			c->w = geom->width > 1 ? geom->width : conf.float_spawn_width;
-			c->h = geom->height > 1 ? geom->height : conf.float_spawn_height;
-			c->x = conf.center_floating ? (screen_width / 2) - (c->w / 2) : geom->x;
-			c->y = conf.center_floating ? (screen_height - wss[cw].bar_height - c->h) / 2 : geom->y;
+			c->w = j->w > 1 ? j->w : conf.float_spawn_width;
+			c->h = j->h > 1 ? j->h : conf.float_spawn_height;
+			c->x = conf.center_floating ? (screen_width / 2) - (c->w / 2) : j->x;
+			c->y = conf.center_floating ? (screen_height - wss[j->ws].bar_height - c->h) / 2 : j->y;
 		}
-		free(geom);
+	}
+
+	if (j->ws != cw) {
+		log_info("Managing client <%p> on workspace <%d>, which is hidden", c, j->ws);
+		wss[j->ws].current = c;
+		grab_buttons(c);
+		return;
 	}
 
 	arrange_windows();
@@ -143,6 +144,7 @@ static void destroy_event(xcb_generic_event_t *ev)
 	xcb_destroy_notify_event_t *de = (xcb_destroy_notify_event_t *)ev;
 	Client *c = find_client_by_win(de->window);
 
+	xworker_cancel(de->window);
 	if (!c)
 		return;
 	log_info("Client <%p> wants to be destroyed", c);
@@ -214,7 +216,6 @@ static void unmap_event(xcb_generic_event_t *ev)
 		remove_client(c, true);
 		arrange_windows();
 	}
-	howm_info();
 }
 
 /**
@@ -233,6 +234,7 @@ static void client_message_event(xcb_generic_event_t *ev)
 			ewmh_process_wm_state(c, (xcb_atom_t) cm->data.data32[2], cm->data.data32[0]);
 	} else if (c && cm->type == ewmh->_NET_CLOSE_WINDOW) {
 		log_info("_NET_CLOSE_WINDOW: Removing client <%p>", c);
+		close_client(c);
 		remove_client(c, true);
 		arrange_windows();
 	} else if (c && cm->type == ewmh->_NET_ACTIVE_WINDOW) {
@@ -247,13 +249,71 @@ static void client_message_event(xcb_generic_event_t *ev)
 	}
 }
 
+/**
+ * @brief Handle a change to one of a client's properties.
+ *
+ * When a client changes its WM_PROTOCOLS, they are fetched again by the X
+ * worker, so that closing the client uses the right method.
+ *
+ * @param ev The property notify event.
+ */
+static void property_event(xcb_generic_event_t *ev)
+{
+	xcb_property_notify_event_t *pe = (xcb_property_notify_event_t *)ev;
+
+	if (pe->atom != wm_atoms[WM_PROTOCOLS] || !find_client_by_win(pe->window))
+		return;
+	log_debug("WM_PROTOCOLS of window <0x%x> changed", pe->window);
+	xworker_protocols(pe->window);
+}
+
 static void unhandled_event(xcb_generic_event_t *ev)
 {
+	UNUSED(ev);
 	log_debug("Unhandled event: %d", ev->response_type & ~0x80);
 }
 
+#ifdef HAVE_SDT
+/**
+ * @brief Find the window that an event is about, for probes.
+ *
+ * @return The window, or 0 for events that howm doesn't handle.
+ */
+static xcb_window_t event_window(xcb_generic_event_t *ev)
+{
+	switch (ev->response_type & ~0x80) {
+	case XCB_BUTTON_PRESS:
+		return ((xcb_button_press_event_t *)ev)->event;
+	case XCB_MAP_REQUEST:
+		return ((xcb_map_request_event_t *)ev)->window;
+	case XCB_DESTROY_NOTIFY:
+		return ((xcb_destroy_notify_event_t *)ev)->window;
+	case XCB_ENTER_NOTIFY:
+		return ((xcb_enter_notify_event_t *)ev)->event;
+	case XCB_CONFIGURE_NOTIFY:
+		return ((xcb_configure_notify_event_t *)ev)->window;
+	case XCB_UNMAP_NOTIFY:
+		return ((xcb_unmap_notify_event_t *)ev)->window;
+	case XCB_CLIENT_MESSAGE:
+		return ((xcb_client_message_event_t *)ev)->window;
+	case XCB_PROPERTY_NOTIFY:
+		return ((xcb_property_notify_event_t *)ev)->window;
+	default:
+		return 0;
+	}
+}
+#endif
+
 void handle_event(xcb_generic_event_t *ev)
 {
+	PROBE4(event_start, ev->response_type & ~0x80, cw, wss[cw].client_cnt,
+			event_window(ev));
+	/* Other events may depend on what is on screen, so commands are only
+	 * coalesced across key presses. */
+	if ((ev->response_type & ~0x80) != XCB_KEY_PRESS
+			&& (ev->response_type & ~0x80) != XCB_KEY_RELEASE)
+		ipc_coalesce_flush();
+	xstats_begin(XSTATS_EVENT(ev->response_type));
 	switch (ev->response_type & ~0x80) {
 	case XCB_BUTTON_PRESS:
 		button_press_event(ev);
@@ -276,8 +336,20 @@ void handle_event(xcb_generic_event_t *ev)
 	case XCB_CLIENT_MESSAGE:
 		client_message_event(ev);
 		break;
+	case XCB_PROPERTY_NOTIFY:
+		property_event(ev);
+		break;
+	case XCB_KEY_PRESS:
+		keys_press((xcb_key_press_event_t *)ev);
+		break;
+	case XCB_MAPPING_NOTIFY:
+		keys_mapping((xcb_mapping_notify_event_t *)ev);
+		break;
 	default:
 		unhandled_event(ev);
 		break;
 	}
+	xstats_end();
+	PROBE4(event_done, ev->response_type & ~0x80, cw, wss[cw].client_cnt,
+			event_window(ev));
 }
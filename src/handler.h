@@ -11,6 +11,9 @@
  * @brief howm
  */
 
+struct xworker_job;
+
 void handle_event(xcb_generic_event_t *ev);
+void manage_window(const struct xworker_job *j);
 
 #endif
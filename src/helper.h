@@ -4,6 +4,7 @@
 #include <err.h>
 #include <errno.h>
 #include <stdio.h>
+#include "log.h"
 
 /**
  * @file helper.h
@@ -36,15 +37,24 @@
 /** Determine which file descriptor is the largest and add one to it. */
 #define MAX_FD(x, y) ((x) > (y) ? (x + 1) : (y + 1))
 
-/** How much detail should be logged. A LOG_LEVEL of INFO will log almost
- * everything, LOG_WARN will log warnings and errors and LOG_ERR will log only
- * errors.
+/** The least severe messages that are compiled into howm. A LOG_LEVEL of INFO
+ * will log almost everything, LOG_WARN will log warnings and errors and
+ * LOG_ERR will log only errors.
  *
  * LOG_NONE means nothing will be logged.
  *
- * LOG_DEBUG should be used by developers.
+ * LOG_DEBUG should be used by developers and is the default for debug builds.
+ *
+ * Messages that are compiled in are then filtered at runtime by
+ * conf.log_level.
  */
+#ifndef LOG_LEVEL
+#ifdef NDEBUG
+#define LOG_LEVEL LOG_INFO
+#else
 #define LOG_LEVEL LOG_DEBUG
+#endif
+#endif
 
 /** Enable debugging output */
 #define DEBUG_ENABLE false
@@ -69,27 +79,36 @@
 #define LOG_ERR 4
 #define LOG_NONE 5
 
+/** Check the runtime log level before doing any work, then hand the format
+ * string and raw args over to the logger. They are formatted and written
+ * later, when howm is idle. */
+#define LOG_AT(L, M, ...) \
+	do { \
+		if (conf.log_level <= (L)) \
+			log_write(L, __FILE__, __LINE__, M, ##__VA_ARGS__); \
+	} while (0)
+
 #if LOG_LEVEL == LOG_DEBUG
-#define log_debug(M, ...) fprintf(stderr, "[DEBUG] (%s:%d) " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+#define log_debug(M, ...) LOG_AT(LOG_DEBUG, M, ##__VA_ARGS__)
 #else
 #define log_debug(x, ...) do {} while (0)
 #endif
 
 
 #if LOG_LEVEL <= LOG_INFO
-#define log_info(M, ...) fprintf(stderr, "[INFO] (%s:%d) " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+#define log_info(M, ...) LOG_AT(LOG_INFO, M, ##__VA_ARGS__)
 #else
 #define log_info(x, ...) do {} while (0)
 #endif
 
 #if LOG_LEVEL <= LOG_WARN
-#define log_warn(M, ...) fprintf(stderr, "[WARN] (%s:%d) " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+#define log_warn(M, ...) LOG_AT(LOG_WARN, M, ##__VA_ARGS__)
 #else
 #define log_warn(x, ...) do {} while (0)
 #endif
 
 #if LOG_LEVEL <= LOG_ERR
-#define log_err(M, ...) fprintf(stderr, "[ERROR] (%s:%d) " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+#define log_err(M, ...) LOG_AT(LOG_ERR, M, ##__VA_ARGS__)
 #else
 #define log_err(x, ...) do {} while (0)
 #endif
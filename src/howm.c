@@ -1,5 +1,6 @@
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +17,19 @@
 #include "scratchpad.h"
 #include "ipc.h"
 #include "handler.h"
+#include "snapshot.h"
+#include "query.h"
+#include "status.h"
+#include "xstats.h"
+#include "startup.h"
+#include "watchdog.h"
+#include "xlatency.h"
+#include "metrics.h"
+#include "keys.h"
+#include "fifo.h"
+#include "scheduler.h"
+#include "proc.h"
+#include "xworker.h"
 
 /**
  * @file howm.c
@@ -60,6 +74,14 @@ struct config conf = {
 	.delete_register_size = 5,
 	.scratchpad_height = 500,
 	.scratchpad_width = 500,
+	.status_format = STATUS_FORMAT,
+	.status_interval = 0,
+	.watchdog_ms = 50,
+	.xlatency_interval = 0,
+	.metrics_path = "",
+	.metrics_interval = 10000,
+	.command_fifo = "",
+	.sched_quantum = 32,
 };
 
 
@@ -69,7 +91,8 @@ xcb_connection_t *dpy = NULL;
 xcb_screen_t *screen = NULL;
 xcb_ewmh_connection_t *ewmh = NULL;
 Workspace wss[WORKSPACES + 1];
-const char *WM_ATOM_NAMES[] = { "WM_DELETE_WINDOW", "WM_PROTOCOLS" };
+const char *WM_ATOM_NAMES[] = { "WM_DELETE_WINDOW", "WM_PROTOCOLS",
+	"WM_TAKE_FOCUS" };
 xcb_atom_t wm_atoms[LENGTH(WM_ATOM_NAMES)];
 
 int numlockmask = 0;
@@ -113,16 +136,18 @@ static void setup(void)
 	log_info("Screen's height is: %d", screen_height);
 	log_info("Screen's width is: %d", screen_width);
 
-	get_atoms(WM_ATOM_NAMES, wm_atoms);
+	get_atoms(WM_ATOM_NAMES, wm_atoms, LENGTH(WM_ATOM_NAMES));
+	startup_mark(STARTUP_ATOMS);
 	setup_ewmh();
+	startup_mark(STARTUP_EWMH);
 
 	conf.border_focus = get_colour(DEF_BORDER_FOCUS);
 	conf.border_unfocus = get_colour(DEF_BORDER_UNFOCUS);
 	conf.border_prev_focus = get_colour(DEF_BORDER_PREV_FOCUS);
 	conf.border_urgent = get_colour(DEF_BORDER_URGENT);
+	startup_mark(STARTUP_COLOURS);
 	stack_init(&del_reg);
-
-	howm_info();
+	status_init();
 }
 
 /**
@@ -132,20 +157,17 @@ int main(int argc, char *argv[])
 {
 	UNUSED(argc);
 	UNUSED(argv);
-	fd_set descs;
-	int sock_fd, dpy_fd, cmd_fd, ret;
-	ssize_t n;
-	xcb_generic_event_t *ev;
+	fd_set descs, wdescs;
+	struct timeval tv, xtv, mtv, zero;
+	int dpy_fd, max_fd, ret;
+	bool backlog = false;
 	char ch;
 	char conf_path[128];
-	char *data = calloc(IPC_BUF_SIZE, sizeof(char));
-
-	if (!data) {
-		log_err("Can't allocate memory for socket buffer.");
-		exit(EXIT_FAILURE);
-	}
 
+	startup_mark(STARTUP_MAIN);
 	conf_path[0] = '\0';
+	log_init();
+	proc_init();
 
 	while ((ch = getopt(argc, argv, "c:")) != -1) {
 		switch (ch) {
@@ -162,48 +184,62 @@ int main(int argc, char *argv[])
 		log_err("Can't open X connection");
 		exit(EXIT_FAILURE);
 	}
+	startup_mark(STARTUP_CONNECT);
 	setup();
-	sock_fd = ipc_init();
+	snapshot_init();
+	startup_mark(STARTUP_SETUP);
+	ipc_init();
+	startup_mark(STARTUP_IPC_INIT);
 	check_other_wm();
+	startup_mark(STARTUP_CHECK_WM);
+	xworker_init();
 	dpy_fd = xcb_get_file_descriptor(dpy);
+	fcntl(dpy_fd, F_SETFD, FD_CLOEXEC);
 	if (conf_path[0] != '\0')
 		exec_config(conf_path);
 	else
 		log_err("No config path was supplied");
+	startup_mark(STARTUP_EXEC_CONFIG);
+	watchdog_init();
 
 	while (running) {
+		ipc_coalesce_flush();
+		snapshot_update();
+		status_update();
+		xlatency_update();
+		metrics_update();
+		log_flush();
 		if (!xcb_flush(dpy))
 			log_err("Failed to flush X connection");
 
 		FD_ZERO(&descs);
+		FD_ZERO(&wdescs);
 		FD_SET(dpy_fd, &descs);
-		FD_SET(sock_fd, &descs);
-
-		if (select(MAX_FD(dpy_fd, sock_fd), &descs, NULL, NULL, NULL) > 0) {
-			if (FD_ISSET(sock_fd, &descs)) {
-				cmd_fd = accept(sock_fd, NULL, 0);
-				if (cmd_fd == -1) {
-					log_err("Failed to accept connection");
-					continue;
-				}
-				n = read(cmd_fd, data, IPC_BUF_SIZE - 1);
-				if (n > 0) {
-					data[n] = '\0';
-					ret = ipc_process(data, n);
-					if (write(cmd_fd, &ret, sizeof(int)) == -1)
-						log_err("Unable to send response. errno: %d", errno);
-					close(cmd_fd);
-				}
-			}
-			if (FD_ISSET(dpy_fd, &descs)) {
-				while ((ev = xcb_poll_for_event(dpy)) != NULL) {
-					if (ev)
-						handle_event(ev);
-					else
-						log_debug("Unimplemented event: %d", ev->response_type & ~0x80);
-					free(ev);
-				}
+		max_fd = ipc_set_fds(&descs, dpy_fd + 1);
+		max_fd = fifo_set_fds(&descs, max_fd);
+		max_fd = proc_set_fds(&descs, max_fd);
+		max_fd = xworker_set_fds(&descs, max_fd);
+		max_fd = status_set_fds(&wdescs, max_fd);
+
+		watchdog_idle();
+		/* Don't sleep whilst the scheduler has work left over. */
+		zero.tv_sec = zero.tv_usec = 0;
+		ret = select(max_fd, &descs, &wdescs, NULL, backlog ? &zero
+				: metrics_timeout(&mtv,
+				xlatency_timeout(&xtv, status_timeout(&tv))));
+		if (ret > 0 || backlog) {
+			if (ret <= 0) {
+				FD_ZERO(&descs);
+				FD_ZERO(&wdescs);
 			}
+			watchdog_busy();
+			startup_mark(STARTUP_FIRST_EVENT);
+			xlatency_update();
+			ipc_handle_fds(&descs);
+			fifo_handle_fds(&descs);
+			proc_handle_fds(&descs);
+			xworker_handle_fds(&descs);
+			backlog = sched_run(FD_ISSET(dpy_fd, &descs));
 			if (xcb_connection_has_error(dpy)) {
 				log_err("XCB connection encountered an error.");
 				running = false;
@@ -211,10 +247,17 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	watchdog_cleanup();
+	xworker_cleanup();
+	metrics_cleanup();
+	keys_cleanup();
 	cleanup();
 	xcb_disconnect(dpy);
-	close(sock_fd);
-	free(data);
+	ipc_cleanup();
+	fifo_cleanup();
+	proc_cleanup();
+	snapshot_cleanup();
+	query_cleanup();
 
 	if (!running && !restart) {
 		return retval;
@@ -227,29 +270,6 @@ int main(int argc, char *argv[])
 	return EXIT_FAILURE;
 }
 
-/**
- * @brief Print debug information about the current state of howm.
- *
- * This can be parsed by programs such as scripts that will pipe their input
- * into a status bar.
- */
-void howm_info(void)
-{
-	unsigned int w = 0;
-#if DEBUG_ENABLE
-	for (w = 1; w <= WORKSPACES; w++) {
-		fprintf(stdout, "%u:%d:%u:%u:%u\n", cur_mode,
-		       wss[w].layout, w, cur_state, wss[w].client_cnt);
-	}
-	fflush(stdout);
-#else
-	UNUSED(w);
-	fprintf(stdout, "%u:%d:%u:%u:%u\n", cur_mode,
-		wss[cw].layout, cw, cur_state, wss[cw].client_cnt);
-	fflush(stdout);
-#endif
-}
-
 /**
  * @brief Cleanup howm's resources.
  *
@@ -317,11 +337,10 @@ uint32_t get_colour(char *colour)
  */
 static void exec_config(char *conf_path)
 {
-	if (fork())
-		return;
-	setsid();
-	execl(conf_path, conf_path, NULL);
-	log_err("Couldn't execute the configuration file %s", conf_path);
+	char *argv[] = { conf_path, NULL };
+
+	if (!proc_spawn(argv, false))
+		log_err("Couldn't execute the configuration file %s", conf_path);
 }
 
 /**
@@ -357,13 +376,5 @@ void quit_howm(const int exit_status)
  */
 void spawn(char *cmd[])
 {
-	if (fork())
-		return;
-	if (dpy)
-		close(screen->root);
-	setsid();
-	log_info("Spawning command: %s", (char *)cmd[0]);
-	execvp((char *)cmd[0], (char **)cmd);
-	log_err("execvp of command: %s failed.", (char *)cmd[0]);
-	exit(EXIT_FAILURE);
+	proc_spawn(cmd, true);
 }
@@ -12,6 +12,7 @@
 
 #define WORKSPACES 5
 #define IPC_BUF_SIZE 1024
+#define IPC_MAX_CONNS 8
 #define HOWM_PATH "/usr/bin/howm"
 #define SOCK_PATH "/tmp/howm"
 #define WS_DEF_LAYOUT HSTACK
@@ -21,6 +22,10 @@
 #define DEF_BORDER_PREV_FOCUS "#74718E"
 #define DEF_BORDER_URGENT "#FF0000"
 #define GAP 0
+#define STATUS_FORMAT "%m:%l:%w:%s:%c"
+#define STATUS_FORMAT_SIZE 64
+#define METRICS_PATH_SIZE 256
+#define FIFO_PATH_SIZE 256
 
 /**
  * @file howm.h
@@ -52,6 +57,14 @@ struct config {
 	unsigned int delete_register_size;
 	uint16_t scratchpad_height;
 	uint16_t scratchpad_width;
+	char status_format[STATUS_FORMAT_SIZE];
+	unsigned int status_interval;
+	unsigned int watchdog_ms;
+	unsigned int xlatency_interval;
+	char metrics_path[METRICS_PATH_SIZE];
+	unsigned int metrics_interval;
+	char command_fifo[FIFO_PATH_SIZE];
+	unsigned int sched_quantum;
 };
 
 enum states { OPERATOR_STATE, COUNT_STATE, MOTION_STATE, END_STATE };
@@ -79,7 +92,6 @@ extern struct config conf;
 extern const char *WM_ATOM_NAMES[];
 extern xcb_atom_t wm_atoms[];
 
-void howm_info(void);
 uint32_t get_colour(char *colour);
 void quit_howm(const int exit_status);
 void restart_howm(void);
@@ -1,6 +1,10 @@
+#define _POSIX_C_SOURCE 200809L
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -12,8 +16,16 @@
 #include "mode.h"
 #include "op.h"
 #include "ipc.h"
+#include "ipc_io.h"
 #include "helper.h"
 #include "howm.h"
+#include "snapshot.h"
+#include "query.h"
+#include "xstats.h"
+#include "startup.h"
+#include "probes.h"
+#include "keys.h"
+#include "fifo.h"
 
 #define SET_INT(opt, arg, lower, upper) \
 	do { \
@@ -29,8 +41,23 @@
 				opt = b; \
 	} while (0)
 
+#define SET_STR(opt, arg) \
+	do { \
+		if (!arg) { \
+			err = IPC_ERR_TOO_FEW_ARGS; \
+			break; \
+		} \
+		if (strlen(arg) >= sizeof(opt)) \
+			return IPC_ERR_ARG_TOO_LARGE; \
+		strcpy(opt, arg); \
+	} while (0)
+
 #define SET_COLOUR(opt, arg) \
 	do { \
+		if (!arg) { \
+			err = IPC_ERR_TOO_FEW_ARGS; \
+			break; \
+		} \
 		if (strlen(arg) > 7) \
 			return IPC_ERR_ARG_TOO_LARGE; \
 		else if (strlen(arg) < 7) \
@@ -38,7 +65,24 @@
 		opt = get_colour(arg); \
 	} while (0)
 
-enum msg_type { MSG_FUNCTION = 1, MSG_CONFIG };
+/**
+ * @brief A command that can be called over IPC.
+ *
+ * Both the text and binary protocols look commands up in the same table,
+ * either by name or by opcode.
+ */
+struct ipc_command {
+	const char *name; /**< The name used by the text protocol. */
+	enum arg_types type; /**< The type of arg that the function takes. */
+	int lower; /**< The inclusive lower bound of an integer arg. */
+	int upper; /**< The inclusive upper bound of an integer arg. */
+	union {
+		void (*none)(void);
+		void (*num)(const int);
+		int (*str)(char **); /**< Returns an error code from ipc_errs. */
+		void (*op)(const unsigned int, int);
+	} func; /**< The function to call, chosen by type. */
+};
 
 /**
  * @file ipc.c
@@ -51,13 +95,67 @@ enum msg_type { MSG_FUNCTION = 1, MSG_CONFIG };
  * are sent over IPC.
  */
 
-static char **ipc_process_args(char *msg, int len, int *err);
 static int ipc_arg_to_int(char *arg, int *err, int lower, int upper);
-static int ipc_process_function(char **args);
 static int ipc_process_config(char **args);
+static int ipc_set_command_fifo(const char *path);
 static bool ipc_arg_to_bool(char *arg, int *err);
+static int ipc_spawn(char **args);
+static int ipc_motion(char **args);
+static bool ipc_coalesce(unsigned int opcode);
+static int ipc_command_class(unsigned int opcode);
+
+static const struct ipc_command commands[IPC_OP_END] = {
+	[IPC_OP_TELEPORT_CLIENT] = { "teleport_client", TYPE_INT, TOP_LEFT, BOTTOM_RIGHT, { .num = teleport_client } },
+	[IPC_OP_MOVE_CURRENT_DOWN] = { "move_current_down", TYPE_IGNORE, 0, 0, { .none = move_current_down } },
+	[IPC_OP_MOVE_CURRENT_UP] = { "move_current_up", TYPE_IGNORE, 0, 0, { .none = move_current_up } },
+	[IPC_OP_FOCUS_NEXT_CLIENT] = { "focus_next_client", TYPE_IGNORE, 0, 0, { .none = focus_next_client } },
+	[IPC_OP_FOCUS_PREV_CLIENT] = { "focus_prev_client", TYPE_IGNORE, 0, 0, { .none = focus_prev_client } },
+	[IPC_OP_CURRENT_TO_WS] = { "current_to_ws", TYPE_INT, 1, WORKSPACES, { .num = current_to_ws } },
+	[IPC_OP_TOGGLE_FLOAT] = { "toggle_float", TYPE_IGNORE, 0, 0, { .none = toggle_float } },
+	[IPC_OP_RESIZE_FLOAT_WIDTH] = { "resize_float_width", TYPE_INT, -100, 100, { .num = resize_float_width } },
+	[IPC_OP_RESIZE_FLOAT_HEIGHT] = { "resize_float_height", TYPE_INT, -100, 100, { .num = resize_float_height } },
+	[IPC_OP_MOVE_FLOAT_X] = { "move_float_x", TYPE_INT, -100, 100, { .num = move_float_x } },
+	[IPC_OP_MOVE_FLOAT_Y] = { "move_float_y", TYPE_INT, -100, 100, { .num = move_float_y } },
+	[IPC_OP_TOGGLE_FULLSCREEN] = { "toggle_fullscreen", TYPE_IGNORE, 0, 0, { .none = toggle_fullscreen } },
+	[IPC_OP_FOCUS_URGENT] = { "focus_urgent", TYPE_IGNORE, 0, 0, { .none = focus_urgent } },
+	[IPC_OP_SEND_TO_SCRATCHPAD] = { "send_to_scratchpad", TYPE_IGNORE, 0, 0, { .none = send_to_scratchpad } },
+	[IPC_OP_GET_FROM_SCRATCHPAD] = { "get_from_scratchpad", TYPE_IGNORE, 0, 0, { .none = get_from_scratchpad } },
+	[IPC_OP_MAKE_MASTER] = { "make_master", TYPE_IGNORE, 0, 0, { .none = make_master } },
+	[IPC_OP_TOGGLE_BAR] = { "toggle_bar", TYPE_IGNORE, 0, 0, { .none = toggle_bar } },
+	[IPC_OP_RESIZE_MASTER] = { "resize_master", TYPE_INT, -100, 100, { .num = resize_master } },
+	[IPC_OP_FOCUS_NEXT_WS] = { "focus_next_ws", TYPE_IGNORE, 0, 0, { .none = focus_next_ws } },
+	[IPC_OP_FOCUS_PREV_WS] = { "focus_prev_ws", TYPE_IGNORE, 0, 0, { .none = focus_prev_ws } },
+	[IPC_OP_FOCUS_LAST_WS] = { "focus_last_ws", TYPE_IGNORE, 0, 0, { .none = focus_last_ws } },
+	[IPC_OP_CHANGE_WS] = { "change_ws", TYPE_INT, 1, WORKSPACES, { .num = change_ws } },
+	[IPC_OP_CHANGE_MODE] = { "change_mode", TYPE_INT, NORMAL, END_MODES - 1, { .num = change_mode } },
+	[IPC_OP_QUIT_HOWM] = { "quit_howm", TYPE_INT, EXIT_SUCCESS, EXIT_FAILURE, { .num = quit_howm } },
+	[IPC_OP_RESTART_HOWM] = { "restart_howm", TYPE_IGNORE, 0, 0, { .none = restart_howm } },
+	[IPC_OP_PASTE] = { "paste", TYPE_IGNORE, 0, 0, { .none = paste } },
+	[IPC_OP_CHANGE_LAYOUT] = { "change_layout", TYPE_INT, ZOOM, END_LAYOUT - 1, { .num = change_layout } },
+	[IPC_OP_NEXT_LAYOUT] = { "next_layout", TYPE_IGNORE, 0, 0, { .none = next_layout } },
+	[IPC_OP_PREV_LAYOUT] = { "prev_layout", TYPE_IGNORE, 0, 0, { .none = prev_layout } },
+	[IPC_OP_LAST_LAYOUT] = { "last_layout", TYPE_IGNORE, 0, 0, { .none = last_layout } },
+	[IPC_OP_SPAWN] = { "spawn", TYPE_STR, 0, 0, { .str = ipc_spawn } },
+	[IPC_OP_COUNT] = { "count", TYPE_INT, 1, 9, { .num = count } },
+	[IPC_OP_MOTION] = { "motion", TYPE_STR, 0, 0, { .str = ipc_motion } },
+	[IPC_OP_OP_KILL] = { "op_kill", TYPE_OP, 0, 0, { .op = op_kill } },
+	[IPC_OP_OP_MOVE_UP] = { "op_move_up", TYPE_OP, 0, 0, { .op = op_move_up } },
+	[IPC_OP_OP_MOVE_DOWN] = { "op_move_down", TYPE_OP, 0, 0, { .op = op_move_down } },
+	[IPC_OP_OP_FOCUS_DOWN] = { "op_focus_down", TYPE_OP, 0, 0, { .op = op_focus_down } },
+	[IPC_OP_OP_FOCUS_UP] = { "op_focus_up", TYPE_OP, 0, 0, { .op = op_focus_up } },
+	[IPC_OP_OP_SHRINK_GAPS] = { "op_shrink_gaps", TYPE_OP, 0, 0, { .op = op_shrink_gaps } },
+	[IPC_OP_OP_GROW_GAPS] = { "op_grow_gaps", TYPE_OP, 0, 0, { .op = op_grow_gaps } },
+	[IPC_OP_OP_CUT] = { "op_cut", TYPE_OP, 0, 0, { .op = op_cut } },
+	[IPC_OP_OPERATE] = { "operate", TYPE_STR, 0, 0, { .str = operate } }
+};
+
+/** The last command whose redraw is being deferred, see ipc_coalesce(). */
+static unsigned int coalesced;
 
-int ipc_init(void)
+/**
+ * @brief Start listening on howm's socket, which is served by the I/O thread.
+ */
+void ipc_init(void)
 {
 	struct sockaddr_un addr;
 	int sock_fd;
@@ -72,6 +170,7 @@ int ipc_init(void)
 		log_err("Couldn't create the socket.");
 		exit(EXIT_FAILURE);
 	}
+	fcntl(sock_fd, F_SETFD, FD_CLOEXEC);
 
 	if (bind(sock_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
 		log_err("Couldn't bind a name to the socket.");
@@ -83,136 +182,567 @@ int ipc_init(void)
 		exit(EXIT_FAILURE);
 	}
 
-	return sock_fd;
+	ipc_io_init(sock_fd);
+}
+
+
+/**
+ * @brief Find the command that has the given name.
+ *
+ * @param name The name of the command, as sent by a text message.
+ *
+ * @return The command, or NULL if there isn't one called name.
+ */
+static const struct ipc_command *ipc_find_command(const char *name)
+{
+	unsigned int i;
+
+	for (i = 1; i < LENGTH(commands); i++)
+		if (commands[i].name && strcmp(name, commands[i].name) == 0)
+			return &commands[i];
+	return NULL;
 }
 
-int ipc_process(char *msg, int len)
+/**
+ * @brief Call the function belonging to a command.
+ *
+ * The args have already been decoded and checked by whichever protocol the
+ * command arrived over.
+ *
+ * @param cmd The command to be run.
+ * @param i The integer arg, used for TYPE_INT commands.
+ * @param args A NULL terminated array of strings, used for TYPE_STR commands.
+ *
+ * @return The error code.
+ */
+static int ipc_run_command(const struct ipc_command *cmd, int i, char **args)
 {
 	int err = IPC_ERR_NONE;
-	char **args = ipc_process_args(msg, len, &err);
 
-	if (**args == MSG_FUNCTION)
-		err = ipc_process_function(args + 1);
-	else if (**args == MSG_CONFIG)
-		err = ipc_process_config(args + 1);
-	else
-		err = IPC_ERR_UNKNOWN_TYPE;
+	if (!ipc_coalesce(cmd - commands)) {
+		ipc_coalesce_flush();
+	} else {
+		/* One deferral covers the whole run. */
+		if (!coalesced)
+			arrange_defer();
+		coalesced = cmd - commands;
+	}
 
-	free(args);
+	/* An operator doesn't do anything until its motion arrives, which is when
+	 * its requests are counted. */
+	if (cmd->type != TYPE_OP)
+		xstats_begin(XSTATS_IPC(cmd - commands));
+	switch (cmd->type) {
+	case TYPE_IGNORE:
+		cmd->func.none();
+		break;
+	case TYPE_INT:
+		cmd->func.num(i);
+		break;
+	case TYPE_STR:
+		err = cmd->func.str(args);
+		break;
+	case TYPE_OP:
+		operator_func = cmd->func.op;
+		cur_state = COUNT_STATE;
+		break;
+	}
+	xstats_end();
 	return err;
 }
 
+/**
+ * @brief Decide whether a command's redraw can be merged with those of the
+ * commands around it.
+ *
+ * A held key sends a stream of small moves, resizes or focus changes, each of
+ * which would redraw the workspace. Instead, only howm's state is updated
+ * until ipc_coalesce_flush() is called, at the latest once per iteration of
+ * the main loop, which then redraws once. The commands still run one by one,
+ * so the result is exactly the same as redrawing after each.
+ *
+ * @param opcode The command that is about to run, from ipc_opcodes.
+ *
+ * @return True if the command's redraw can be deferred.
+ */
+static bool ipc_coalesce(unsigned int opcode)
+{
+	switch (opcode) {
+	case IPC_OP_MOVE_FLOAT_X:
+	case IPC_OP_MOVE_FLOAT_Y:
+	case IPC_OP_RESIZE_FLOAT_WIDTH:
+	case IPC_OP_RESIZE_FLOAT_HEIGHT:
+	case IPC_OP_RESIZE_MASTER:
+	case IPC_OP_FOCUS_NEXT_CLIENT:
+	case IPC_OP_FOCUS_PREV_CLIENT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief Redraw after a run of coalesced commands. The redraw's requests are
+ * counted against the last command of the run.
+ */
+void ipc_coalesce_flush(void)
+{
+	if (!coalesced)
+		return;
+	xstats_resume(XSTATS_IPC(coalesced));
+	coalesced = 0;
+	arrange_flush();
+	xstats_end();
+}
 
 /**
- * @brief Receive a char array from a UNIX socket and subsequently call a
- * function, passing the args from within msg.
+ * @brief Get the name of a command.
  *
- * @param args The args (as strings).
+ * @param opcode The command's opcode, from ipc_opcodes.
  *
- * @return The error code, as set by this function itself or those that it
- * calls.
+ * @return The name used by the text protocol, or NULL if there is no such
+ * command.
  */
-static int ipc_process_function(char **args)
+const char *ipc_command_name(unsigned int opcode)
+{
+	return opcode < LENGTH(commands) ? commands[opcode].name : NULL;
+}
+
+/**
+ * @brief Check that a command has been given the args that it needs.
+ *
+ * @param cmd The command.
+ * @param args The args (as strings), NULL terminated.
+ * @param i Set to the integer arg, for TYPE_INT commands.
+ *
+ * @return The error code.
+ */
+static int ipc_check_args(const struct ipc_command *cmd, char **args, int *i)
 {
 	int err = IPC_ERR_NONE;
 
-	if (strncmp(*args, "teleport_client", strlen("teleport_client")) == 0) {
-		teleport_client(ipc_arg_to_int(*(args + 1), &err, TOP_LEFT, BOTTOM_RIGHT));
-	} else if (strncmp(*args, "move_current_down", strlen("move_current_down")) == 0) {
-		move_current_down();
-	} else if (strncmp(*args, "move_current_up", strlen("move_current_up")) == 0) {
-		move_current_up();
-	} else if (strncmp(*args, "focus_next_client", strlen("focus_next_client")) == 0) {
-		focus_next_client();
-	} else if (strncmp(*args, "focus_prev_client", strlen("focus_prev_client")) == 0) {
-		focus_prev_client();
-	} else if (strncmp(*args, "current_to_ws", strlen("current_to_ws")) == 0) {
-		current_to_ws(ipc_arg_to_int(*(args + 1), &err, 1, WORKSPACES));
-	} else if (strncmp(*args, "toggle_float", strlen("toggle_float")) == 0) {
-		toggle_float();
-	} else if (strncmp(*args, "resize_float_width", strlen("resize_float_width")) == 0) {
-		resize_float_width(ipc_arg_to_int(*(args + 1), &err, -100, 100));
-	} else if (strncmp(*args, "resize_float_height", strlen("resize_float_height")) == 0) {
-		resize_float_height(ipc_arg_to_int(*(args + 1), &err, -100, 100));
-	} else if (strncmp(*args, "move_float_x", strlen("move_float_x")) == 0) {
-		move_float_x(ipc_arg_to_int(*(args + 1), &err, -100, 100));
-	} else if (strncmp(*args, "move_float_y", strlen("move_float_y")) == 0) {
-		move_float_y(ipc_arg_to_int(*(args + 1), &err, -100, 100));
-	} else if (strncmp(*args, "toggle_fullscreen", strlen("toggle_fullscreen")) == 0) {
-		toggle_fullscreen();
-	} else if (strncmp(*args, "focus_urgent", strlen("focus_urgent")) == 0) {
-		focus_urgent();
-	} else if (strncmp(*args, "send_to_scratchpad", strlen("send_to_scratchpad")) == 0) {
-		send_to_scratchpad();
-	} else if (strncmp(*args, "get_from_scratchpad", strlen("get_from_scratchpad")) == 0) {
-		get_from_scratchpad();
-	} else if (strncmp(*args, "make_master", strlen("make_master")) == 0) {
-		make_master();
-	} else if (strncmp(*args, "toggle_bar", strlen("toggle_bar")) == 0) {
-		toggle_bar();
-	} else if (strncmp(*args, "resize_master", strlen("resize_master")) == 0) {
-		resize_master(ipc_arg_to_int(*(args + 1), &err, -100, 100));
-	} else if (strncmp(*args, "focus_next_ws", strlen("focus_next_ws")) == 0) {
-		focus_next_ws();
-	} else if (strncmp(*args, "focus_prev_ws", strlen("focus_prev_ws")) == 0) {
-		focus_prev_ws();
-	} else if (strncmp(*args, "focus_last_ws", strlen("focus_last_ws")) == 0) {
-		focus_last_ws();
-	} else if (strncmp(*args, "change_ws", strlen("change_ws")) == 0) {
-		change_ws(ipc_arg_to_int(*(args + 1), &err, 1, WORKSPACES));
-	} else if (strncmp(*args, "change_mode", strlen("change_mode")) == 0) {
-		change_mode(ipc_arg_to_int(*(args + 1), &err, NORMAL, END_MODES - 1));
-	} else if (strncmp(*args, "quit_howm", strlen("quit_howm")) == 0) {
-		quit_howm(ipc_arg_to_int(*(args + 1), &err, EXIT_SUCCESS, EXIT_FAILURE));
-	} else if (strncmp(*args, "restart_howm", strlen("restart_howm")) == 0) {
-		restart_howm();
-	} else if (strncmp(*args, "paste", strlen("paste")) == 0) {
-		paste();
-	} else if (strncmp(*args, "change_layout", strlen("change_layout")) == 0) {
-		change_layout(ipc_arg_to_int(*(args + 1), &err, ZOOM, END_LAYOUT - 1));
-	} else if (strncmp(*args, "next_layout", strlen("next_layout")) == 0) {
-		next_layout();
-	} else if (strncmp(*args, "prev_layout", strlen("prev_layout")) == 0) {
-		prev_layout();
-	} else if (strncmp(*args, "last_layout", strlen("last_layout")) == 0) {
-		last_layout();
-	} else if (strncmp(*args, "spawn", strlen("spawn")) == 0) {
-		spawn(args + 1);
-	} else if (strncmp(*args, "count", strlen("count")) == 0) {
-		count(ipc_arg_to_int(*(args + 1), &err, 1, 9));
-	} else if (strncmp(*args, "motion", strlen("motion")) == 0) {
-		motion(*(args + 1));
-	} else if (strncmp(*args, "op_kill", strlen("op_kill")) == 0) {
-		operator_func = op_kill;
-		cur_state = COUNT_STATE;
-	} else if (strncmp(*args, "op_move_up", strlen("op_move_up")) == 0) {
-		operator_func = op_move_up;
-		cur_state = COUNT_STATE;
-	} else if (strncmp(*args, "op_move_down", strlen("op_move_down")) == 0) {
-		operator_func = op_move_down;
-		cur_state = COUNT_STATE;
-	} else if (strncmp(*args, "op_focus_down", strlen("op_focus_down")) == 0) {
-		operator_func = op_focus_down;
-		cur_state = COUNT_STATE;
-	} else if (strncmp(*args, "op_focus_up", strlen("op_focus_up")) == 0) {
-		operator_func = op_focus_up;
-		cur_state = COUNT_STATE;
-	} else if (strncmp(*args, "op_shrink_gaps", strlen("op_shrink_gaps")) == 0) {
-		operator_func = op_shrink_gaps;
-		cur_state = COUNT_STATE;
-	} else if (strncmp(*args, "op_grow_gaps", strlen("op_grow_gaps")) == 0) {
-		operator_func = op_grow_gaps;
-		cur_state = COUNT_STATE;
-	} else if (strncmp(*args, "op_cut", strlen("op_cut")) == 0) {
-		operator_func = op_cut;
-		cur_state = COUNT_STATE;
-	} else {
+	*i = 0;
+	if (cmd->type == TYPE_INT)
+		*i = ipc_arg_to_int(*args, &err, cmd->lower, cmd->upper);
+	else if (cmd->type == TYPE_STR && !*args)
+		err = IPC_ERR_TOO_FEW_ARGS;
+	return err;
+}
+
+/**
+ * @brief Get the opcode of a command.
+ *
+ * @param name The name of the command, as sent by a text message.
+ *
+ * @return The command's opcode, from ipc_opcodes, or 0 if there is no such
+ * command.
+ */
+unsigned int ipc_command_opcode(const char *name)
+{
+	const struct ipc_command *cmd = ipc_find_command(name);
+
+	return cmd ? (unsigned int)(cmd - commands) : 0;
+}
+
+/**
+ * @brief Check a command's args without running it.
+ *
+ * @param opcode The command's opcode, from ipc_opcodes.
+ * @param args The args (as strings), NULL terminated.
+ *
+ * @return The error code that running the command would give.
+ */
+int ipc_command_check(unsigned int opcode, char **args)
+{
+	int i;
+
+	if (opcode == 0 || opcode >= LENGTH(commands))
 		return IPC_ERR_NO_FUNC;
-	}
+	return ipc_check_args(&commands[opcode], args, &i);
+}
 
+/**
+ * @brief Run a command from within howm, without a message.
+ *
+ * @param opcode The command's opcode, from ipc_opcodes.
+ * @param args The args (as strings), NULL terminated.
+ *
+ * @return The error code.
+ */
+int ipc_command_run(unsigned int opcode, char **args)
+{
+	int err;
+	int i;
+
+	if (opcode == 0 || opcode >= LENGTH(commands))
+		return IPC_ERR_NO_FUNC;
+	err = ipc_check_args(&commands[opcode], args, &i);
+	if (err == IPC_ERR_NONE)
+		err = ipc_run_command(&commands[opcode], i, args);
 	return err;
 }
 
+/**
+ * @brief Decode a binary frame.
+ *
+ * Integers are read straight out of the frame and string args are left in
+ * place, stored as offsets.
+ *
+ * @param m The message, whose data holds a whole frame.
+ *
+ * @return The error code to send back for this frame.
+ */
+static int ipc_decode_frame(struct ipc_msg *m)
+{
+	unsigned char *p = (unsigned char *)m->data;
+	unsigned char *end;
+	const struct ipc_command *cmd;
+	unsigned int argc, types = 0, nint = 0;
+	unsigned int op, plen, slen;
+
+	plen = get_le16(p + 4);
+	if (p[1] != IPC_BIN_VERSION)
+		return IPC_ERR_BAD_VERSION;
+	op = get_le16(p + 2);
+	argc = p[6];
+	if (op >= LENGTH(commands) || !commands[op].name)
+		return IPC_ERR_NO_FUNC;
+	if (argc > IPC_BIN_MAX_ARGS)
+		return IPC_ERR_TOO_MANY_ARGS;
+	cmd = &commands[op];
+	m->opcode = op;
+
+	end = p + IPC_BIN_HDR_SIZE + plen;
+	for (p += IPC_BIN_HDR_SIZE; argc > 0; argc--) {
+		if (p >= end)
+			return IPC_ERR_BAD_FRAME;
+		if (*p == TYPE_INT) {
+			if (end - p < 5)
+				return IPC_ERR_BAD_FRAME;
+			if (nint++ == 0)
+				m->num = get_le32(p + 1);
+			types |= 1 << TYPE_INT;
+			p += 5;
+		} else if (*p == TYPE_STR) {
+			if (end - p < 3)
+				return IPC_ERR_BAD_FRAME;
+			slen = get_le16(p + 1);
+			p += 3;
+			if (slen == 0 || end - p < (long)slen || p[slen - 1] != '\0')
+				return IPC_ERR_BAD_FRAME;
+			m->argv[m->argc++] = (char *)p - m->data;
+			types |= 1 << TYPE_STR;
+			p += slen;
+		} else {
+			return IPC_ERR_UNKNOWN_TYPE;
+		}
+	}
+
+	if (cmd->type == TYPE_INT) {
+		if (nint == 0)
+			return (types & (1 << TYPE_STR)) ? IPC_ERR_ARG_NOT_INT : IPC_ERR_TOO_FEW_ARGS;
+		if (m->num > cmd->upper)
+			return IPC_ERR_ARG_TOO_LARGE;
+		if (m->num < cmd->lower)
+			return IPC_ERR_ARG_TOO_SMALL;
+	} else if (cmd->type == TYPE_STR && m->argc == 0) {
+		return IPC_ERR_TOO_FEW_ARGS;
+	}
+	return IPC_ERR_NONE;
+}
+
+/**
+ * @brief Decode a text message.
+ *
+ * The message is split into strings, each terminated by a NULL character.
+ * The first holds the message's type and, for a function, the second is the
+ * command's name. Any data after the last NULL character is ignored.
+ *
+ * @param m The message, whose data holds the text.
+ *
+ * @return The error code, such as when there are too few args.
+ */
+static int ipc_decode_text(struct ipc_msg *m)
+{
+	uint16_t offs[IPC_MSG_MAX_ARGS + 2];
+	char *args[IPC_MSG_MAX_ARGS + 1];
+	const struct ipc_command *cmd = NULL;
+	unsigned int i, argc = 0, start = 0, first = 1;
+
+	for (i = 0; i + 1 < m->len; i++) {
+		if (m->data[i] != '\0')
+			continue;
+		if (argc == LENGTH(offs))
+			return IPC_ERR_TOO_MANY_ARGS;
+		offs[argc++] = start;
+		start = i + 1;
+	}
+	if (argc < 1)
+		return IPC_ERR_TOO_FEW_ARGS;
+
+	m->type = m->data[0];
+	if (m->type == MSG_FUNCTION) {
+		if (argc < 2)
+			return IPC_ERR_TOO_FEW_ARGS;
+		cmd = ipc_find_command(m->data + offs[1]);
+		if (!cmd)
+			return IPC_ERR_NO_FUNC;
+		m->opcode = cmd - commands;
+		first = 2;
+	} else if (m->type != MSG_CONFIG && m->type != MSG_SNAPSHOT
+			&& m->type != MSG_QUERY) {
+		return IPC_ERR_UNKNOWN_TYPE;
+	}
+
+	if (argc - first > IPC_MSG_MAX_ARGS)
+		return IPC_ERR_TOO_MANY_ARGS;
+	for (i = first; i < argc; i++) {
+		m->argv[m->argc] = offs[i];
+		args[m->argc++] = m->data + offs[i];
+	}
+	args[m->argc] = NULL;
+
+	return cmd ? ipc_check_args(cmd, args, &m->num) : IPC_ERR_NONE;
+}
+
+/**
+ * @brief Decode a message, without running it. This is called by the I/O
+ * thread.
+ *
+ * @param m Where the decoded message is stored.
+ * @param proto The protocol of the connection, from protocols.
+ * @param buf The message, as it was read.
+ * @param len The length of the message, which must be less than
+ * IPC_BUF_SIZE.
+ *
+ * @return The error code that the message will be answered with, instead of
+ * being run, or IPC_ERR_NONE.
+ */
+int ipc_decode(struct ipc_msg *m, int proto, const char *buf, int len)
+{
+	memcpy(m->data, buf, len);
+	m->data[len] = '\0';
+	m->len = len + 1;
+	m->type = MSG_FUNCTION;
+	m->argc = 0;
+	m->opcode = 0;
+	m->num = 0;
+	m->err = proto == PROTO_BIN ? ipc_decode_frame(m) : ipc_decode_text(m);
+	return m->err;
+}
+
+/**
+ * @brief Decide how urgent a command is.
+ *
+ * @param opcode The command, from ipc_opcodes.
+ *
+ * @return The command's class, from ipc_classes.
+ */
+static int ipc_command_class(unsigned int opcode)
+{
+	return opcode == IPC_OP_SPAWN ? IPC_CLASS_BULK : IPC_CLASS_INTERACTIVE;
+}
+
+/**
+ * @brief Find the class of a decoded message.
+ *
+ * Functions are interactive, unless they are only used to start programs.
+ * Configuration, snapshots and queries are bulk. Messages that couldn't be
+ * decoded are answered straight away.
+ *
+ * @param m The message.
+ *
+ * @return The class, from ipc_classes.
+ */
+int ipc_msg_class(const struct ipc_msg *m)
+{
+	if (m->err != IPC_ERR_NONE)
+		return IPC_CLASS_INTERACTIVE;
+	if (m->type != MSG_FUNCTION)
+		return IPC_CLASS_BULK;
+	return ipc_command_class(m->opcode);
+}
+
+/**
+ * @brief Add a new reader to the snapshot, for a MSG_SNAPSHOT message.
+ *
+ * The file descriptors are duplicated, as the snapshot may close its own
+ * before the I/O thread has sent them. If the snapshot or the reader's
+ * eventfd couldn't be created, or the file descriptors couldn't be
+ * duplicated, the reply's error is IPC_ERR_ALLOC.
+ *
+ * @param r The reply, which the file descriptors are stored in.
+ */
+static void ipc_snapshot_reply(struct ipc_reply *r)
+{
+	int fds[2];
+	int i, n = snapshot_add_reader(fds);
+
+	for (i = 0; i < n; i++) {
+		r->fds[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, 0);
+		if (r->fds[i] == -1)
+			break;
+		r->nfds++;
+	}
+	if (n <= 0 || r->nfds < n) {
+		log_err("Unable to share the snapshot. errno: %d", errno);
+		for (i = 0; i < r->nfds; i++)
+			close(r->fds[i]);
+		r->nfds = 0;
+		r->err = IPC_ERR_ALLOC;
+	}
+}
+
+/**
+ * @brief Answer a MSG_QUERY message. The result is copied, so that the I/O
+ * thread can send it whilst the next query is being run.
+ *
+ * @param r The reply, which the result is stored in.
+ * @param args The name of the query and its args, NULL terminated.
+ */
+static void ipc_query_reply(struct ipc_reply *r, char **args)
+{
+	const char *data = NULL;
+	size_t size = 0;
+
+	r->err = query_run(args, &data, &size);
+	if (size == 0)
+		return;
+	r->data = malloc(size);
+	if (!r->data) {
+		r->err = IPC_ERR_ALLOC;
+		return;
+	}
+	memcpy(r->data, data, size);
+	r->len = size;
+}
+
+/**
+ * @brief Run a decoded message.
+ *
+ * @param m The message.
+ * @param r Where the reply is stored.
+ */
+static void ipc_run_msg(const struct ipc_msg *m, struct ipc_reply *r)
+{
+	char *args[IPC_MSG_MAX_ARGS + 1];
+	unsigned int i;
+
+	memset(r, 0, sizeof(*r));
+	r->conn = m->conn;
+	r->type = m->type;
+	r->err = m->err;
+	if (m->err != IPC_ERR_NONE)
+		return;
+	for (i = 0; i < m->argc; i++)
+		args[i] = (char *)m->data + m->argv[i];
+	args[m->argc] = NULL;
+
+	PROBE1(ipc_start, m->type);
+	switch (m->type) {
+	case MSG_FUNCTION:
+		r->err = ipc_run_command(&commands[m->opcode], m->num, args);
+		break;
+	case MSG_CONFIG:
+		r->err = ipc_process_config(args);
+		startup_config();
+		break;
+	case MSG_SNAPSHOT:
+		ipc_snapshot_reply(r);
+		break;
+	case MSG_QUERY:
+		ipc_query_reply(r, args);
+		break;
+	}
+	PROBE2(ipc_done, m->type, r->err);
+}
+
+/**
+ * @brief Run waiting messages of one class, in the order that the I/O thread
+ * queued them, and hand their replies back to it.
+ *
+ * @param cls The class of message to run, from ipc_classes.
+ * @param quantum The most messages to run.
+ *
+ * @return The amount of messages that were run.
+ */
+unsigned int ipc_run(int cls, unsigned int quantum)
+{
+	struct ipc_msg *m;
+	struct ipc_reply r;
+	unsigned int done = 0;
+
+	while (done < quantum && (m = ipc_io_peek(cls)) != NULL) {
+		ipc_run_msg(m, &r);
+		ipc_io_pop(cls);
+		ipc_io_reply(&r);
+		done++;
+	}
+	if (done > 0)
+		ipc_io_wake();
+	return done;
+}
+
+/**
+ * @brief Count the messages that are waiting to be run.
+ *
+ * @param cls The class of message to count, from ipc_classes.
+ *
+ * @return The amount of messages of that class that have been decoded but not
+ * yet run.
+ */
+unsigned int ipc_queue_depth(int cls)
+{
+	return ipc_io_depth(cls);
+}
+
+/**
+ * @brief Add the file descriptor that the I/O thread signals when messages
+ * are waiting to a set of file descriptors.
+ *
+ * @param descs The set that will be passed to select.
+ * @param max_fd The current value of the highest fd plus one.
+ *
+ * @return The new value of the highest fd plus one.
+ */
+int ipc_set_fds(fd_set *descs, int max_fd)
+{
+	int fd = ipc_io_fd();
+
+	FD_SET(fd, descs);
+	return MAX_FD(fd, max_fd - 1);
+}
+
+/**
+ * @brief Acknowledge the I/O thread's signal, if select has marked it as
+ * readable. The messages themselves are run by ipc_run().
+ *
+ * @param descs The set of file descriptors returned by select.
+ */
+void ipc_handle_fds(fd_set *descs)
+{
+	if (FD_ISSET(ipc_io_fd(), descs))
+		ipc_io_clear();
+}
+
+/**
+ * @brief Stop the I/O thread and close all open connections.
+ */
+void ipc_cleanup(void)
+{
+	ipc_io_cleanup();
+}
+
+/**
+ * @brief Count the connections that are open.
+ *
+ * @return The amount of connection slots in use, out of IPC_MAX_CONNS.
+ */
+unsigned int ipc_open_conns(void)
+{
+	return ipc_io_conns();
+}
+
 /**
  * @brief Convert a numerical string into a decimal value, such as "12"
  * becoming 12.
@@ -246,77 +776,6 @@ static int ipc_arg_to_int(char *arg, int *err, int lower, int upper)
 	return ret;
 }
 
-/**
- * @brief Accepts a char array and convert it into an array of strings.
- *
- * msg is split into strings (delimited by a null character) and placed in an
- * array. err is set with a corresponding error (such as args too few args), or
- * nothing.
- *
- * XXX: args must be freed by the caller.
- *
- * @param msg A char array that is read from a UNIX socket.
- * @param len The length of data in msg.
- * @param err Where any errors will be stored.
- *
- * @return A pointer to an array of strings, each one representing an argument
- * that has been passed over a UNIX socket.
- */
-static char **ipc_process_args(char *msg, int len, int *err)
-{
-	int argc = 0, i = 0, arg_start = 0, lim = 2;
-	char **args = malloc(lim * sizeof(char *));
-
-	if (!args) {
-		*err = IPC_ERR_ALLOC;
-		return NULL;
-	}
-
-	for (; i < len; i++) {
-		if (msg[i] == 0) {
-			*(args + argc++) = msg + arg_start;
-			arg_start = i + 1;
-
-			if (argc == lim) {
-				lim *= 2;
-				char **new = realloc(args, lim * sizeof(char *));
-
-				if (!new) {
-					*err = IPC_ERR_ALLOC;
-					free(args);
-					return NULL;
-				}
-				args = new;
-			}
-		}
-	}
-
-	/* Make room to add the NULL after the last character. */
-	if (argc == lim) {
-		char **new = realloc(args, (lim + 1) * sizeof(char *));
-
-		if (!new) {
-			*err = IPC_ERR_ALLOC;
-			return NULL;
-		}
-		args = new;
-	}
-
-	/* The end of the array should be NULL, as the whole array can be passed to
-	 * spawn() and that expects a NULL terminated array.
-	 *
-	 * Use argc here as args are zero indexed. */
-	*(args + argc) = NULL;
-
-	if (argc < 1) {
-		*err = IPC_ERR_TOO_FEW_ARGS;
-		free(args);
-		return NULL;
-	}
-
-	return args;
-}
-
 static int ipc_process_config(char **args)
 {
 	int err = IPC_ERR_NONE;
@@ -360,10 +819,95 @@ static int ipc_process_config(char **args)
 		SET_COLOUR(conf.border_prev_focus, *(args + 1));
 	else if (strcmp("border_urgent", *args) == 0)
 		SET_COLOUR(conf.border_urgent, *(args + 1));
+	else if (strcmp("status_format", *args) == 0)
+		SET_STR(conf.status_format, *(args + 1));
+	else if (strcmp("status_interval", *args) == 0)
+		SET_INT(conf.status_interval, *(args + 1), 0, 60000);
+	else if (strcmp("log_level", *args) == 0)
+		SET_INT(conf.log_level, *(args + 1), LOG_DEBUG, LOG_NONE);
+	else if (strcmp("watchdog_ms", *args) == 0)
+		SET_INT(conf.watchdog_ms, *(args + 1), 0, 60000);
+	else if (strcmp("xlatency_interval", *args) == 0)
+		SET_INT(conf.xlatency_interval, *(args + 1), 0, 60000);
+	else if (strcmp("metrics_path", *args) == 0)
+		SET_STR(conf.metrics_path, *(args + 1));
+	else if (strcmp("metrics_interval", *args) == 0)
+		SET_INT(conf.metrics_interval, *(args + 1), 0, 60000);
+	else if (strcmp("bind", *args) == 0)
+		err = keys_bind(args + 1);
+	else if (strcmp("unbind", *args) == 0)
+		err = keys_unbind(args + 1);
+	else if (strcmp("command_fifo", *args) == 0)
+		err = ipc_set_command_fifo(*(args + 1));
+	else if (strcmp("sched_quantum", *args) == 0)
+		SET_INT(conf.sched_quantum, *(args + 1), 1, 1024);
 	update_focused_client(wss[cw].current);
 	return err;
 }
 
+/**
+ * @brief Start reading commands from a new FIFO.
+ *
+ * The config only changes once the FIFO has been opened, otherwise howm goes
+ * back to reading from the FIFO that it was using before.
+ *
+ * @param path The path of the FIFO, or an empty string to stop reading from
+ * one.
+ *
+ * @return The error code.
+ */
+static int ipc_set_command_fifo(const char *path)
+{
+	int err;
+
+	if (!path)
+		return IPC_ERR_TOO_FEW_ARGS;
+	if (strlen(path) >= sizeof(conf.command_fifo))
+		return IPC_ERR_ARG_TOO_LARGE;
+	err = fifo_open(path);
+	if (err == IPC_ERR_NONE)
+		strcpy(conf.command_fifo, path);
+	else
+		fifo_open(conf.command_fifo);
+	return err;
+}
+
+/**
+ * @brief Start the program given by a spawn command.
+ *
+ * @param args The program and its args.
+ *
+ * @return The error code.
+ */
+static int ipc_spawn(char **args)
+{
+	spawn(args);
+	return IPC_ERR_NONE;
+}
+
+/**
+ * @brief Pass the first arg of a motion command on to motion().
+ *
+ * @param args The args of the command.
+ *
+ * @return The error code.
+ */
+static int ipc_motion(char **args)
+{
+	unsigned int i;
+
+	/* Count the requests against the operator that is being applied. */
+	for (i = 1; i < LENGTH(commands); i++) {
+		if (commands[i].type == TYPE_OP && commands[i].func.op == operator_func) {
+			xstats_end();
+			xstats_begin(XSTATS_IPC(i));
+			break;
+		}
+	}
+	motion(*args);
+	return IPC_ERR_NONE;
+}
+
 static bool ipc_arg_to_bool(char *arg, int *err)
 {
 	if (strcmp("true", arg) == 0
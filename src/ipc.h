@@ -1,6 +1,8 @@
 #ifndef IPC_H
 #define IPC_H
 
+#include <sys/select.h>
+
 /**
  * @file ipc.h
  *
@@ -11,13 +13,80 @@
  * @brief howm
  */
 
+/** The first byte of a binary frame. It can never be confused with the type
+ * byte that starts a text message, so the protocol is chosen by looking at the
+ * first byte sent over a connection. */
+#define IPC_BIN_MAGIC 0xB0
+/** The version of the binary frame layout that howm understands. */
+#define IPC_BIN_VERSION 1
+/** The size of a binary frame's header in bytes. */
+#define IPC_BIN_HDR_SIZE 8
+/** The maximum amount of args that a binary frame may carry. */
+#define IPC_BIN_MAX_ARGS 16
+
+/* A binary frame is laid out as follows, with all fields little endian:
+ *
+ * offset 0: uint8_t  magic (IPC_BIN_MAGIC)
+ * offset 1: uint8_t  version (IPC_BIN_VERSION)
+ * offset 2: uint16_t opcode (enum ipc_opcodes)
+ * offset 4: uint16_t length of the payload that follows the header
+ * offset 6: uint8_t  amount of args in the payload
+ * offset 7: uint8_t  reserved, must be zero
+ *
+ * Each arg in the payload starts with a uint8_t holding its arg_type:
+ *
+ * TYPE_INT: followed by an int32_t.
+ * TYPE_STR: followed by a uint16_t length and that many bytes, the last of
+ * which must be a NULL character.
+ *
+ * howm replies to every frame with an int32_t error code from ipc_errs.
+ */
+
+/** The first byte of a text message, saying what it contains. MSG_SNAPSHOT
+ * asks for the snapshot's file descriptors, see snapshot.h. MSG_QUERY is
+ * answered with the error code, a uint32_t length and then the reply, see
+ * query.h. */
+enum msg_type { MSG_FUNCTION = 1, MSG_CONFIG, MSG_SNAPSHOT, MSG_QUERY };
 enum ipc_errs { IPC_ERR_NONE, IPC_ERR_SYNTAX, IPC_ERR_ALLOC, IPC_ERR_NO_FUNC,
 	IPC_ERR_TOO_MANY_ARGS, IPC_ERR_TOO_FEW_ARGS, IPC_ERR_ARG_NOT_INT,
 	IPC_ERR_ARG_NOT_BOOL, IPC_ERR_ARG_TOO_LARGE, IPC_ERR_ARG_TOO_SMALL,
-	IPC_ERR_UNKNOWN_TYPE };
-enum arg_types { TYPE_IGNORE, TYPE_INT, TYPE_STR };
+	IPC_ERR_UNKNOWN_TYPE, IPC_ERR_BAD_VERSION, IPC_ERR_BAD_FRAME };
+enum arg_types { TYPE_IGNORE, TYPE_INT, TYPE_STR, TYPE_OP };
+/** How urgently messages are run. Interactive commands (such as changing
+ * focus or workspace) are run before X events, bulk ones (starting programs,
+ * configuration, snapshots and queries) after them. */
+enum ipc_classes { IPC_CLASS_NONE, IPC_CLASS_INTERACTIVE, IPC_CLASS_BULK,
+	IPC_CLASS_END };
+
+/** The opcodes used by binary frames. New commands must be appended so that
+ * existing clients keep working. */
+enum ipc_opcodes { IPC_OP_TELEPORT_CLIENT = 1, IPC_OP_MOVE_CURRENT_DOWN,
+	IPC_OP_MOVE_CURRENT_UP, IPC_OP_FOCUS_NEXT_CLIENT,
+	IPC_OP_FOCUS_PREV_CLIENT, IPC_OP_CURRENT_TO_WS, IPC_OP_TOGGLE_FLOAT,
+	IPC_OP_RESIZE_FLOAT_WIDTH, IPC_OP_RESIZE_FLOAT_HEIGHT,
+	IPC_OP_MOVE_FLOAT_X, IPC_OP_MOVE_FLOAT_Y, IPC_OP_TOGGLE_FULLSCREEN,
+	IPC_OP_FOCUS_URGENT, IPC_OP_SEND_TO_SCRATCHPAD,
+	IPC_OP_GET_FROM_SCRATCHPAD, IPC_OP_MAKE_MASTER, IPC_OP_TOGGLE_BAR,
+	IPC_OP_RESIZE_MASTER, IPC_OP_FOCUS_NEXT_WS, IPC_OP_FOCUS_PREV_WS,
+	IPC_OP_FOCUS_LAST_WS, IPC_OP_CHANGE_WS, IPC_OP_CHANGE_MODE,
+	IPC_OP_QUIT_HOWM, IPC_OP_RESTART_HOWM, IPC_OP_PASTE,
+	IPC_OP_CHANGE_LAYOUT, IPC_OP_NEXT_LAYOUT, IPC_OP_PREV_LAYOUT,
+	IPC_OP_LAST_LAYOUT, IPC_OP_SPAWN, IPC_OP_COUNT, IPC_OP_MOTION,
+	IPC_OP_OP_KILL, IPC_OP_OP_MOVE_UP, IPC_OP_OP_MOVE_DOWN,
+	IPC_OP_OP_FOCUS_DOWN, IPC_OP_OP_FOCUS_UP, IPC_OP_OP_SHRINK_GAPS,
+	IPC_OP_OP_GROW_GAPS, IPC_OP_OP_CUT, IPC_OP_OPERATE, IPC_OP_END };
 
-int ipc_init(void);
-int ipc_process(char *msg, int len);
+void ipc_init(void);
+int ipc_set_fds(fd_set *descs, int max_fd);
+void ipc_handle_fds(fd_set *descs);
+unsigned int ipc_run(int cls, unsigned int quantum);
+unsigned int ipc_queue_depth(int cls);
+void ipc_cleanup(void);
+void ipc_coalesce_flush(void);
+unsigned int ipc_open_conns(void);
+const char *ipc_command_name(unsigned int opcode);
+unsigned int ipc_command_opcode(const char *name);
+int ipc_command_check(unsigned int opcode, char **args);
+int ipc_command_run(unsigned int opcode, char **args);
 
 #endif
@@ -0,0 +1,678 @@
+#define _GNU_SOURCE
+#include <sys/eventfd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ipc_io.h"
+#include "howm.h"
+#include "helper.h"
+#include "ipc.h"
+
+/**
+ * @file ipc_io.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Read, decode and answer IPC messages on a thread of their own.
+ *
+ * The I/O thread owns howm's socket and every connection to it. It reads
+ * messages, decodes them and passes them to the main thread through a queue
+ * for each class of message. The main thread runs them and passes the
+ * replies back through another queue, which the I/O thread writes out. Each
+ * queue has a single producer and a single consumer, so no locks are needed,
+ * and each side is woken by an eventfd. The main thread never reads from or
+ * writes to a client, so a slow client (or one reading a large query) can't
+ * stall it.
+ *
+ * Every socket is non-blocking. A reply that a client isn't reading fast
+ * enough is kept with its connection and sent as the socket drains, and
+ * nothing more is read from that connection until it has all been sent.
+ *
+ * A connection's replies must be sent in the order that its messages arrived,
+ * so all of a connection's messages that are in flight are in the same queue.
+ * At most IPC_MAX_INFLIGHT messages from one connection are in flight at
+ * once, which stops a busy connection from filling the queues and means that
+ * they can never overflow.
+ */
+
+/**
+ * @brief A connection to howm's socket.
+ *
+ * Storage for the connections is static, so reading from a client never
+ * allocates memory.
+ */
+struct ipc_conn {
+	bool open; /**< Is this slot in use? */
+	int fd; /**< The file descriptor of the connection. */
+	int proto; /**< The protocol that was negotiated, from protocols. */
+	int len; /**< The amount of data in buf that hasn't been queued. */
+	bool eof; /**< Is there nothing more to read? */
+	unsigned int inflight; /**< Messages queued or waiting to be answered. */
+	int inflight_cls; /**< The class of the messages in flight. */
+	unsigned int nreplies; /**< The amount of replies in replies. */
+	unsigned char replies[IPC_MAX_INFLIGHT * sizeof(int32_t)]; /**< Replies
+			to binary frames, sent together. */
+	char *out; /**< Output that the socket hasn't taken yet. */
+	size_t out_len; /**< The amount of data in out. */
+	size_t out_off; /**< How much of out has been sent. */
+	char buf[IPC_BUF_SIZE]; /**< Data that has been read but not queued. */
+};
+
+/**
+ * @brief Messages of one class, waiting to be run by the main thread.
+ */
+struct ipc_queue {
+	struct ipc_msg msgs[IPC_QUEUE_SIZE];
+	unsigned int head; /**< Only written by the I/O thread. */
+	unsigned int tail; /**< Only written by the main thread. */
+};
+
+/**
+ * @brief Replies, waiting to be sent by the I/O thread.
+ */
+struct ipc_replies {
+	struct ipc_reply replies[IPC_QUEUE_SIZE];
+	unsigned int head; /**< Only written by the main thread. */
+	unsigned int tail; /**< Only written by the I/O thread. */
+};
+
+static int listen_fd = -1;
+static int wake_main = -1; /**< Signalled when messages have been queued. */
+static int wake_io = -1; /**< Signalled when replies have been queued. */
+static pthread_t thread;
+static bool started;
+static bool stop;
+static unsigned int open_conns;
+
+static struct ipc_queue queues[IPC_CLASS_END - IPC_CLASS_INTERACTIVE];
+static struct ipc_replies out;
+
+/* Only used by the I/O thread. */
+static struct ipc_conn conns[IPC_MAX_CONNS];
+static struct ipc_msg scratch;
+
+static void signal_fd(int fd)
+{
+	uint64_t one = 1;
+
+	if (write(fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+		log_err("Unable to signal an eventfd. errno: %d", errno);
+}
+
+static void clear_fd(int fd)
+{
+	uint64_t n;
+
+	if (read(fd, &n, sizeof(n)) == -1 && errno != EAGAIN)
+		log_err("Unable to read an eventfd. errno: %d", errno);
+}
+
+static void ipc_io_close(struct ipc_conn *c)
+{
+	close(c->fd);
+	c->open = false;
+	c->len = 0;
+	c->eof = false;
+	c->inflight = 0;
+	c->nreplies = 0;
+	free(c->out);
+	c->out = NULL;
+	c->out_len = c->out_off = 0;
+	__atomic_store_n(&open_conns, open_conns - 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Accept a new connection on howm's socket.
+ *
+ * The connection is made close-on-exec as it is accepted, as the main thread
+ * may be starting a program at the same time.
+ */
+static void ipc_io_accept(void)
+{
+	unsigned int i;
+	int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+
+	if (fd == -1) {
+		log_err("Failed to accept connection");
+		return;
+	}
+	for (i = 0; i < LENGTH(conns); i++) {
+		if (!conns[i].open) {
+			conns[i].fd = fd;
+			conns[i].open = true;
+			conns[i].proto = PROTO_NONE;
+			__atomic_store_n(&open_conns, open_conns + 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+	log_warn("Too many IPC connections, dropping one.");
+	close(fd);
+}
+
+/**
+ * @brief Read from a connection into its buffer.
+ *
+ * The protocol of a connection is decided by the first byte that is sent
+ * over it. Text connections carry a single message and are then closed,
+ * whilst binary connections may carry any amount of frames and stay open
+ * until the other end closes them. Frames that were sent before closing are
+ * still run.
+ *
+ * @param c The connection that has data waiting to be read.
+ */
+static void ipc_io_read(struct ipc_conn *c)
+{
+	ssize_t n;
+
+	n = read(c->fd, c->buf + c->len, IPC_BUF_SIZE - 1 - c->len);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (n <= 0) {
+		c->eof = true;
+		return;
+	}
+	c->len += n;
+
+	if (c->proto == PROTO_NONE)
+		c->proto = ((unsigned char)c->buf[0] == IPC_BIN_MAGIC)
+			? PROTO_BIN : PROTO_TEXT;
+}
+
+/**
+ * @brief Find the size of the binary frame at the start of a buffer.
+ *
+ * @param msg The start of the frame.
+ * @param len The amount of data available.
+ *
+ * @return The size of the frame, 0 if it is incomplete or -1 if it can never
+ * be decoded.
+ */
+static int ipc_frame_size(const char *msg, int len)
+{
+	const unsigned char *p = (const unsigned char *)msg;
+	unsigned int plen;
+
+	if (len < IPC_BIN_HDR_SIZE)
+		return 0;
+	plen = get_le16(p + 4);
+	if (p[0] != IPC_BIN_MAGIC || IPC_BIN_HDR_SIZE + plen > IPC_BUF_SIZE - 1)
+		return -1;
+	if ((unsigned int)len < IPC_BIN_HDR_SIZE + plen)
+		return 0;
+	return IPC_BIN_HDR_SIZE + plen;
+}
+
+/**
+ * @brief Decode the next message waiting on a connection and queue it for
+ * the main thread.
+ *
+ * @param i The index of the connection.
+ *
+ * @return True if a message was queued.
+ */
+static bool ipc_io_queue_conn(unsigned int i)
+{
+	struct ipc_conn *c = &conns[i];
+	struct ipc_queue *q;
+	unsigned int head;
+	int size, cls;
+
+	if (!c->open || c->len == 0 || c->inflight >= IPC_MAX_INFLIGHT)
+		return false;
+	size = c->proto == PROTO_BIN ? ipc_frame_size(c->buf, c->len) : c->len;
+	if (size == 0)
+		return false;
+	if (size < 0) {
+		log_warn("Closing IPC connection with a malformed frame");
+		c->len = 0;
+		c->eof = true;
+		return false;
+	}
+
+	ipc_decode(&scratch, c->proto, c->buf, size);
+	cls = ipc_msg_class(&scratch);
+	if (c->inflight > 0 && cls != c->inflight_cls)
+		return false;
+	scratch.conn = i;
+
+	q = &queues[cls - IPC_CLASS_INTERACTIVE];
+	head = q->head;
+	memcpy(&q->msgs[head % IPC_QUEUE_SIZE], &scratch,
+			offsetof(struct ipc_msg, data) + scratch.len);
+	__atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+
+	c->inflight++;
+	c->inflight_cls = cls;
+	c->len -= size;
+	memmove(c->buf, c->buf + size, c->len);
+	if (c->proto == PROTO_TEXT)
+		c->eof = true;
+	return true;
+}
+
+/**
+ * @brief Queue every message that can be, taking turns between connections
+ * so that a busy connection can't hold up the others. Connections that have
+ * nothing left to do are closed.
+ *
+ * @return True if any message was queued.
+ */
+static bool ipc_io_queue(void)
+{
+	static unsigned int first;
+	unsigned int i;
+	bool queued = false, progress = true;
+
+	while (progress) {
+		progress = false;
+		for (i = 0; i < LENGTH(conns); i++)
+			if (ipc_io_queue_conn((first + i) % LENGTH(conns)))
+				progress = queued = true;
+	}
+	first = (first + 1) % LENGTH(conns);
+
+	for (i = 0; i < LENGTH(conns); i++)
+		if (conns[i].open && conns[i].eof && conns[i].inflight == 0
+				&& conns[i].out_len == 0)
+			ipc_io_close(&conns[i]);
+	return queued;
+}
+
+/**
+ * @brief Send as much of buf as the socket takes without blocking.
+ *
+ * If the other end has gone away, the connection is marked as finished so
+ * that it is closed.
+ *
+ * @param c The connection to write to.
+ * @param buf The data to be written.
+ * @param len The length of buf.
+ *
+ * @return The amount of buf that was sent.
+ */
+static size_t ipc_io_send_some(struct ipc_conn *c, const char *buf, size_t len)
+{
+	size_t sent = 0;
+	ssize_t n;
+
+	while (sent < len) {
+		/* The other end may have closed the connection, which mustn't
+		 * raise SIGPIPE. */
+		n = send(c->fd, buf + sent, len - sent, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == EAGAIN)
+			break;
+		if (n < 0) {
+			if (errno != EPIPE)
+				log_err("Unable to send response. errno: %d", errno);
+			c->eof = true;
+			return len;
+		}
+		sent += n;
+	}
+	return sent;
+}
+
+/**
+ * @brief Send a connection's pending output, as far as the socket allows.
+ *
+ * @param c The connection to write to.
+ */
+static void ipc_io_flush(struct ipc_conn *c)
+{
+	c->out_off += ipc_io_send_some(c, c->out + c->out_off,
+			c->out_len - c->out_off);
+	if (c->out_off < c->out_len)
+		return;
+	free(c->out);
+	c->out = NULL;
+	c->out_len = c->out_off = 0;
+}
+
+/**
+ * @brief Write to a connection without blocking. Whatever the socket doesn't
+ * take is kept and sent once it drains.
+ *
+ * @param c The connection to write to.
+ * @param buf The data to be written.
+ * @param len The length of buf.
+ */
+static void ipc_io_write(struct ipc_conn *c, const char *buf, size_t len)
+{
+	size_t pending = c->out_len - c->out_off;
+	size_t sent = 0;
+	char *out;
+
+	if (pending == 0) {
+		sent = ipc_io_send_some(c, buf, len);
+		if (sent == len)
+			return;
+	}
+	out = malloc(pending + len - sent);
+	if (!out) {
+		log_err("Can't allocate memory for an IPC reply.");
+		c->eof = true;
+		return;
+	}
+	if (pending > 0)
+		memcpy(out, c->out + c->out_off, pending);
+	memcpy(out + pending, buf + sent, len - sent);
+	free(c->out);
+	c->out = out;
+	c->out_len = pending + len - sent;
+	c->out_off = 0;
+}
+
+/**
+ * @brief Reply to a MSG_SNAPSHOT request by sending the snapshot's memfd and
+ * an eventfd that is signalled whenever the snapshot changes.
+ *
+ * The file descriptors are passed as SCM_RIGHTS alongside the usual error
+ * code.
+ *
+ * @param fd The connection to reply on.
+ * @param r The reply, holding the file descriptors.
+ */
+static void ipc_send_snapshot(int fd, const struct ipc_reply *r)
+{
+	int ret = r->err;
+	char cbuf[CMSG_SPACE(sizeof(r->fds))];
+	struct iovec iov = { &ret, sizeof(ret) };
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (r->nfds > 0) {
+		memset(cbuf, 0, sizeof(cbuf));
+		msg.msg_control = cbuf;
+		msg.msg_controllen = CMSG_SPACE(r->nfds * sizeof(int));
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(r->nfds * sizeof(int));
+		memcpy(CMSG_DATA(cmsg), r->fds, r->nfds * sizeof(int));
+	}
+
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) == -1)
+		log_err("Unable to send snapshot. errno: %d", errno);
+}
+
+/**
+ * @brief Answer a MSG_QUERY message.
+ *
+ * The reply is the error code, followed by the length of the serialised
+ * result as a uint32_t and then the result itself.
+ *
+ * @param c The connection to reply on.
+ * @param r The reply, holding the result.
+ */
+static void ipc_send_query(struct ipc_conn *c, const struct ipc_reply *r)
+{
+	char hdr[sizeof(int) + sizeof(uint32_t)];
+	int err = r->err;
+
+	memcpy(hdr, &err, sizeof(int));
+	memcpy(hdr + sizeof(int), &r->len, sizeof(uint32_t));
+	ipc_io_write(c, hdr, sizeof(hdr));
+	if (r->len > 0)
+		ipc_io_write(c, r->data, r->len);
+}
+
+/**
+ * @brief Free whatever a reply holds.
+ */
+static void ipc_free_reply(struct ipc_reply *r)
+{
+	int i;
+
+	for (i = 0; i < r->nfds; i++)
+		close(r->fds[i]);
+	free(r->data);
+}
+
+/**
+ * @brief Send the replies that the main thread has queued.
+ *
+ * Text connections are closed once they have been answered and their reply
+ * has been sent. The replies to binary frames are collected so that each
+ * connection is written to once.
+ */
+static void ipc_io_send(void)
+{
+	struct ipc_reply *r;
+	struct ipc_conn *c;
+	unsigned int tail, i;
+	int err;
+
+	for (tail = out.tail; tail != __atomic_load_n(&out.head, __ATOMIC_ACQUIRE); tail++) {
+		r = &out.replies[tail % IPC_QUEUE_SIZE];
+		c = &conns[r->conn];
+		c->inflight--;
+		if (c->proto == PROTO_BIN) {
+			put_le32(c->replies + c->nreplies++ * sizeof(int32_t), r->err);
+			continue;
+		}
+		if (r->type == MSG_SNAPSHOT) {
+			ipc_send_snapshot(c->fd, r);
+		} else if (r->type == MSG_QUERY) {
+			ipc_send_query(c, r);
+		} else {
+			err = r->err;
+			ipc_io_write(c, (const char *)&err, sizeof(int));
+		}
+		ipc_free_reply(r);
+		/* Once any output that is left has been sent, ipc_io_queue()
+		 * closes the connection. */
+		c->eof = true;
+		if (c->out_len == 0)
+			ipc_io_close(c);
+	}
+	__atomic_store_n(&out.tail, tail, __ATOMIC_RELEASE);
+
+	for (i = 0; i < LENGTH(conns); i++) {
+		c = &conns[i];
+		if (!c->open || c->nreplies == 0)
+			continue;
+		ipc_io_write(c, (const char *)c->replies,
+				c->nreplies * sizeof(int32_t));
+		c->nreplies = 0;
+	}
+}
+
+static void *ipc_io_run(void *arg)
+{
+	fd_set descs, wdescs;
+	unsigned int i;
+	int max_fd;
+
+	UNUSED(arg);
+	while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE)) {
+		FD_ZERO(&descs);
+		FD_ZERO(&wdescs);
+		FD_SET(wake_io, &descs);
+		FD_SET(listen_fd, &descs);
+		max_fd = MAX_FD(wake_io, listen_fd);
+		for (i = 0; i < LENGTH(conns); i++) {
+			if (!conns[i].open)
+				continue;
+			/* Nothing more is read from a connection until its output
+			 * has been sent, and a full buffer is only read from once
+			 * some of it has been queued. */
+			if (conns[i].out_len > 0)
+				FD_SET(conns[i].fd, &wdescs);
+			else if (!conns[i].eof && conns[i].len < IPC_BUF_SIZE - 1)
+				FD_SET(conns[i].fd, &descs);
+			else
+				continue;
+			max_fd = MAX_FD(conns[i].fd, max_fd - 1);
+		}
+
+		if (select(max_fd, &descs, &wdescs, NULL, NULL) == -1) {
+			if (errno == EINTR)
+				continue;
+			log_err("IPC select failed. errno: %d", errno);
+			break;
+		}
+		if (FD_ISSET(wake_io, &descs))
+			clear_fd(wake_io);
+		ipc_io_send();
+		if (FD_ISSET(listen_fd, &descs))
+			ipc_io_accept();
+		for (i = 0; i < LENGTH(conns); i++) {
+			if (conns[i].open && FD_ISSET(conns[i].fd, &wdescs))
+				ipc_io_flush(&conns[i]);
+			if (conns[i].open && FD_ISSET(conns[i].fd, &descs))
+				ipc_io_read(&conns[i]);
+		}
+		if (ipc_io_queue())
+			signal_fd(wake_main);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Start the I/O thread.
+ *
+ * @param sock_fd The socket that howm is listening on, which the I/O thread
+ * takes ownership of.
+ */
+void ipc_io_init(int sock_fd)
+{
+	listen_fd = sock_fd;
+	wake_main = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	wake_io = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (wake_main == -1 || wake_io == -1) {
+		log_err("Couldn't create eventfds for IPC. errno: %d", errno);
+		exit(EXIT_FAILURE);
+	}
+	if (pthread_create(&thread, NULL, ipc_io_run, NULL) != 0) {
+		log_err("Couldn't start the IPC thread.");
+		exit(EXIT_FAILURE);
+	}
+	started = true;
+}
+
+/**
+ * @brief Get the file descriptor that becomes readable when messages have
+ * been queued for the main thread.
+ */
+int ipc_io_fd(void)
+{
+	return wake_main;
+}
+
+/**
+ * @brief Acknowledge that the main thread has been woken.
+ */
+void ipc_io_clear(void)
+{
+	clear_fd(wake_main);
+}
+
+/**
+ * @brief Get the oldest message of a class, without removing it.
+ *
+ * @param cls The class, from ipc_classes.
+ *
+ * @return The message, or NULL if there are none waiting.
+ */
+struct ipc_msg *ipc_io_peek(int cls)
+{
+	struct ipc_queue *q = &queues[cls - IPC_CLASS_INTERACTIVE];
+
+	if (q->tail == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+		return NULL;
+	return &q->msgs[q->tail % IPC_QUEUE_SIZE];
+}
+
+/**
+ * @brief Remove the oldest message of a class, once it has been run.
+ *
+ * @param cls The class, from ipc_classes.
+ */
+void ipc_io_pop(int cls)
+{
+	struct ipc_queue *q = &queues[cls - IPC_CLASS_INTERACTIVE];
+
+	__atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Queue a reply for the I/O thread to send. It isn't woken until
+ * ipc_io_wake() is called, so that replies can be batched.
+ *
+ * @param r The reply, which is copied.
+ */
+void ipc_io_reply(const struct ipc_reply *r)
+{
+	out.replies[out.head % IPC_QUEUE_SIZE] = *r;
+	__atomic_store_n(&out.head, out.head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Wake the I/O thread to send the replies that have been queued.
+ */
+void ipc_io_wake(void)
+{
+	signal_fd(wake_io);
+}
+
+/**
+ * @brief Count the messages of a class that are waiting to be run.
+ *
+ * @param cls The class, from ipc_classes.
+ */
+unsigned int ipc_io_depth(int cls)
+{
+	struct ipc_queue *q = &queues[cls - IPC_CLASS_INTERACTIVE];
+
+	return __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) - q->tail;
+}
+
+/**
+ * @brief Count the connections that are open.
+ */
+unsigned int ipc_io_conns(void)
+{
+	return __atomic_load_n(&open_conns, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Stop the I/O thread and close every connection.
+ */
+void ipc_io_cleanup(void)
+{
+	unsigned int i;
+
+	if (started) {
+		__atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+		signal_fd(wake_io);
+		pthread_join(thread, NULL);
+		started = false;
+	}
+	for (; out.tail != out.head; out.tail++)
+		ipc_free_reply(&out.replies[out.tail % IPC_QUEUE_SIZE]);
+	for (i = 0; i < LENGTH(conns); i++)
+		if (conns[i].open)
+			ipc_io_close(&conns[i]);
+	if (listen_fd != -1)
+		close(listen_fd);
+	if (wake_main != -1)
+		close(wake_main);
+	if (wake_io != -1)
+		close(wake_io);
+	listen_fd = wake_main = wake_io = -1;
+}
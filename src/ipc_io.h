@@ -0,0 +1,104 @@
+#ifndef IPC_IO_H
+#define IPC_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "howm.h"
+#include "ipc.h"
+
+/**
+ * @file ipc_io.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/** The most args that a decoded message can carry. */
+#define IPC_MSG_MAX_ARGS 64
+/** The most messages from one connection that can be waiting to be run or
+ * answered at once. */
+#define IPC_MAX_INFLIGHT 16
+/** The size of each queue. Every message in flight fits, so they never
+ * overflow. */
+#define IPC_QUEUE_SIZE (IPC_MAX_CONNS * IPC_MAX_INFLIGHT)
+
+enum protocols { PROTO_NONE, PROTO_TEXT, PROTO_BIN };
+
+/**
+ * @brief A message that has been read and decoded by the I/O thread, waiting
+ * to be run by the main thread.
+ *
+ * Args are stored as offsets into data, so that a message can be copied into
+ * a queue after it has been decoded.
+ */
+struct ipc_msg {
+	uint8_t conn; /**< The connection that the message arrived on. */
+	uint8_t type; /**< The type of message, from msg_type. */
+	uint8_t argc; /**< The amount of args in argv. */
+	int err; /**< If the message couldn't be decoded, the error code that
+			it is answered with instead of being run. */
+	unsigned int opcode; /**< The command, for MSG_FUNCTION. */
+	int num; /**< The integer arg, for TYPE_INT commands. */
+	uint16_t argv[IPC_MSG_MAX_ARGS]; /**< The offsets of the args in data,
+			not including the type or the command's name. */
+	uint16_t len; /**< The amount of data. */
+	char data[IPC_BUF_SIZE]; /**< The message, as it was sent. */
+};
+
+/**
+ * @brief The answer to a message, waiting to be sent by the I/O thread.
+ */
+struct ipc_reply {
+	uint8_t conn; /**< The connection that the message arrived on. */
+	uint8_t type; /**< The type of the message, from msg_type. */
+	int32_t err; /**< The error code. */
+	char *data; /**< A query's result, freed once it has been sent. */
+	uint32_t len; /**< The length of data. */
+	int fds[2]; /**< The snapshot's file descriptors, closed once they have
+			been sent. */
+	int nfds; /**< The amount of fds. */
+};
+
+/** Read a little endian uint16_t from a byte array. */
+static inline unsigned int get_le16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+/** Read a little endian int32_t from a byte array. */
+static inline int32_t get_le32(const unsigned char *p)
+{
+	return (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8
+			| (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+/** Write an int32_t into a byte array as little endian. */
+static inline void put_le32(unsigned char *p, int32_t v)
+{
+	p[0] = (uint32_t)v & 0xFF;
+	p[1] = ((uint32_t)v >> 8) & 0xFF;
+	p[2] = ((uint32_t)v >> 16) & 0xFF;
+	p[3] = ((uint32_t)v >> 24) & 0xFF;
+}
+
+/* Implemented in ipc.c, as they need the table of commands. They only read
+ * it, so they are safe to call from the I/O thread. */
+int ipc_decode(struct ipc_msg *m, int proto, const char *buf, int len);
+int ipc_msg_class(const struct ipc_msg *m);
+
+void ipc_io_init(int sock_fd);
+int ipc_io_fd(void);
+void ipc_io_clear(void);
+struct ipc_msg *ipc_io_peek(int cls);
+void ipc_io_pop(int cls);
+void ipc_io_reply(const struct ipc_reply *r);
+void ipc_io_wake(void);
+unsigned int ipc_io_depth(int cls);
+unsigned int ipc_io_conns(void);
+void ipc_io_cleanup(void);
+
+#endif
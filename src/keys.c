@@ -0,0 +1,427 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_keysyms.h>
+#include <X11/keysym.h>
+
+#include "keys.h"
+#include "howm.h"
+#include "helper.h"
+#include "ipc.h"
+#include "mode.h"
+#include "xstats.h"
+
+/**
+ * @file keys.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Grab keys and run the commands that are bound to them.
+ *
+ * Binding keys in howm itself is optional, sxhkd and cottage still work. A
+ * bound key runs its command straight from the command table, without
+ * spawning a process or opening a connection to howm's socket. Only the keys
+ * bound in the current mode (or in every mode) are grabbed, so keys that
+ * aren't bound still reach clients.
+ */
+
+/** A binding that applies in every mode. */
+#define ALL_MODES END_MODES
+/** The modifiers that must match for a binding to be run. */
+#define MODS_MASK (XCB_MOD_MASK_SHIFT | XCB_MOD_MASK_CONTROL | XCB_MOD_MASK_1 \
+		| XCB_MOD_MASK_2 | XCB_MOD_MASK_3 | XCB_MOD_MASK_4 | XCB_MOD_MASK_5)
+
+/**
+ * @brief A key, and the command that it runs.
+ */
+struct binding {
+	bool used; /**< Is this slot in use? */
+	unsigned int mode; /**< The mode, from modes, or ALL_MODES. */
+	uint16_t mods; /**< The modifiers that must be held. */
+	xcb_keysym_t keysym; /**< The key, as it is without any modifiers. */
+	unsigned int opcode; /**< The command, from ipc_opcodes. */
+	char *args[KEYS_MAX_ARGS + 1]; /**< The command's args, pointing into buf. */
+	char buf[KEYS_CMD_SIZE];
+};
+
+static const struct {
+	const char *name;
+	uint16_t mask;
+} mod_names[] = {
+	{ "shift", XCB_MOD_MASK_SHIFT },
+	{ "ctrl", XCB_MOD_MASK_CONTROL },
+	{ "control", XCB_MOD_MASK_CONTROL },
+	{ "alt", XCB_MOD_MASK_1 },
+	{ "mod1", XCB_MOD_MASK_1 },
+	{ "mod2", XCB_MOD_MASK_2 },
+	{ "mod3", XCB_MOD_MASK_3 },
+	{ "super", XCB_MOD_MASK_4 },
+	{ "mod4", XCB_MOD_MASK_4 },
+	{ "mod5", XCB_MOD_MASK_5 },
+};
+
+/* Printable characters are their own keysyms, so only keys without one (and
+ * punctuation, which is awkward to type in a config script) are named. */
+static const struct {
+	const char *name;
+	xcb_keysym_t keysym;
+} keysym_names[] = {
+	{ "space", XK_space }, { "Return", XK_Return }, { "Tab", XK_Tab },
+	{ "Escape", XK_Escape }, { "BackSpace", XK_BackSpace },
+	{ "Delete", XK_Delete }, { "Insert", XK_Insert }, { "Home", XK_Home },
+	{ "End", XK_End }, { "Prior", XK_Prior }, { "Next", XK_Next },
+	{ "Left", XK_Left }, { "Right", XK_Right }, { "Up", XK_Up },
+	{ "Down", XK_Down }, { "Print", XK_Print }, { "Pause", XK_Pause },
+	{ "Menu", XK_Menu }, { "comma", XK_comma }, { "period", XK_period },
+	{ "slash", XK_slash }, { "backslash", XK_backslash },
+	{ "semicolon", XK_semicolon }, { "apostrophe", XK_apostrophe },
+	{ "grave", XK_grave }, { "minus", XK_minus }, { "equal", XK_equal },
+	{ "bracketleft", XK_bracketleft }, { "bracketright", XK_bracketright },
+	{ "F1", XK_F1 }, { "F2", XK_F2 }, { "F3", XK_F3 }, { "F4", XK_F4 },
+	{ "F5", XK_F5 }, { "F6", XK_F6 }, { "F7", XK_F7 }, { "F8", XK_F8 },
+	{ "F9", XK_F9 }, { "F10", XK_F10 }, { "F11", XK_F11 }, { "F12", XK_F12 },
+};
+
+static const char *mode_names[END_MODES] = {
+	[NORMAL] = "normal",
+	[FOCUS] = "focus",
+	[FLOATING] = "floating",
+};
+
+static struct binding bindings[KEYS_MAX_BINDINGS];
+static xcb_key_symbols_t *syms;
+
+static void update_numlock(void);
+
+/**
+ * @brief Parse the name of a mode.
+ *
+ * @param name A mode from mode_names, or "all".
+ *
+ * @return The mode, or -1 if name isn't a mode.
+ */
+static int parse_mode(const char *name)
+{
+	unsigned int i;
+
+	if (strcmp("all", name) == 0)
+		return ALL_MODES;
+	for (i = 0; i < LENGTH(mode_names); i++)
+		if (strcmp(mode_names[i], name) == 0)
+			return i;
+	return -1;
+}
+
+/**
+ * @brief Parse a keysym's name.
+ *
+ * @param name A name from keysym_names, a single printable character or a
+ * hexadecimal keysym, such as 0x1008ff11.
+ *
+ * @return The keysym, or XCB_NO_SYMBOL if name isn't a key.
+ */
+static xcb_keysym_t parse_keysym(const char *name)
+{
+	unsigned int i;
+	char *end;
+	unsigned long k;
+
+	if (name[0] > ' ' && name[0] <= '~' && name[1] == '\0') {
+		/* Keys are matched without shift, which gives lowercase letters. */
+		if (name[0] >= 'A' && name[0] <= 'Z')
+			return name[0] - 'A' + 'a';
+		return name[0];
+	}
+	for (i = 0; i < LENGTH(keysym_names); i++)
+		if (strcmp(keysym_names[i].name, name) == 0)
+			return keysym_names[i].keysym;
+	if (strncmp("0x", name, 2) == 0) {
+		k = strtoul(name + 2, &end, 16);
+		if (*end == '\0' && k > 0 && k <= UINT32_MAX)
+			return k;
+	}
+	return XCB_NO_SYMBOL;
+}
+
+/**
+ * @brief Parse a key, such as super+shift+Return.
+ *
+ * @param key The modifiers and keysym, separated by '+'. This is modified.
+ * @param mods Set to the modifiers.
+ * @param keysym Set to the keysym.
+ *
+ * @return An error code from ipc_errs.
+ */
+static int parse_key(char *key, uint16_t *mods, xcb_keysym_t *keysym)
+{
+	char *tok, *next;
+	unsigned int i;
+
+	*mods = 0;
+	for (tok = key; (next = strchr(tok, '+')) && next[1] != '\0'; tok = next + 1) {
+		*next = '\0';
+		for (i = 0; i < LENGTH(mod_names); i++)
+			if (strcasecmp(mod_names[i].name, tok) == 0)
+				break;
+		if (i == LENGTH(mod_names))
+			return IPC_ERR_SYNTAX;
+		*mods |= mod_names[i].mask;
+	}
+	*keysym = parse_keysym(tok);
+	return *keysym == XCB_NO_SYMBOL ? IPC_ERR_SYNTAX : IPC_ERR_NONE;
+}
+
+/**
+ * @brief Find the binding for a key in a mode.
+ *
+ * @return The binding, or NULL if the key isn't bound in that mode.
+ */
+static struct binding *find_binding(unsigned int mode, uint16_t mods,
+		xcb_keysym_t keysym)
+{
+	unsigned int i;
+
+	for (i = 0; i < LENGTH(bindings); i++)
+		if (bindings[i].used && bindings[i].mode == mode
+				&& bindings[i].mods == mods
+				&& bindings[i].keysym == keysym)
+			return &bindings[i];
+	return NULL;
+}
+
+/**
+ * @brief Bind a key to a command, replacing any existing binding for that
+ * key in the same mode.
+ *
+ * @param args The mode, the key, the command's name and then its args, NULL
+ * terminated. For example: normal super+Return spawn urxvt
+ *
+ * @return An error code from ipc_errs.
+ */
+int keys_bind(char **args)
+{
+	struct binding *b;
+	unsigned int opcode, i, argc;
+	size_t len, used = 0;
+	xcb_keysym_t keysym;
+	uint16_t mods;
+	int mode, err;
+	char key[KEYS_CMD_SIZE];
+
+	if (!args[0] || !args[1] || !args[2])
+		return IPC_ERR_TOO_FEW_ARGS;
+	mode = parse_mode(args[0]);
+	if (mode < 0)
+		return IPC_ERR_SYNTAX;
+	if (strlen(args[1]) >= sizeof(key))
+		return IPC_ERR_ARG_TOO_LARGE;
+	strcpy(key, args[1]);
+	err = parse_key(key, &mods, &keysym);
+	if (err != IPC_ERR_NONE)
+		return err;
+	opcode = ipc_command_opcode(args[2]);
+	if (!opcode)
+		return IPC_ERR_NO_FUNC;
+	err = ipc_command_check(opcode, args + 3);
+	if (err != IPC_ERR_NONE)
+		return err;
+
+	for (argc = 0; args[3 + argc]; argc++) {
+		if (argc == KEYS_MAX_ARGS)
+			return IPC_ERR_TOO_MANY_ARGS;
+		used += strlen(args[3 + argc]) + 1;
+	}
+	if (used > KEYS_CMD_SIZE)
+		return IPC_ERR_ARG_TOO_LARGE;
+
+	b = find_binding(mode, mods, keysym);
+	for (i = 0; !b && i < LENGTH(bindings); i++)
+		if (!bindings[i].used)
+			b = &bindings[i];
+	if (!b) {
+		log_warn("Can't bind more than %d keys", KEYS_MAX_BINDINGS);
+		return IPC_ERR_ALLOC;
+	}
+
+	if (!syms) {
+		syms = xcb_key_symbols_alloc(dpy);
+		if (!syms)
+			return IPC_ERR_ALLOC;
+		update_numlock();
+	}
+
+	b->used = true;
+	b->mode = mode;
+	b->mods = mods;
+	b->keysym = keysym;
+	b->opcode = opcode;
+	for (i = 0, used = 0; i < argc; i++) {
+		len = strlen(args[3 + i]) + 1;
+		memcpy(b->buf + used, args[3 + i], len);
+		b->args[i] = b->buf + used;
+		used += len;
+	}
+	b->args[argc] = NULL;
+	log_debug("Bound %s in mode %s to %s", args[1], args[0], args[2]);
+	keys_grab();
+	return IPC_ERR_NONE;
+}
+
+/**
+ * @brief Remove a key's binding.
+ *
+ * @param args The mode and the key, NULL terminated.
+ *
+ * @return An error code from ipc_errs.
+ */
+int keys_unbind(char **args)
+{
+	struct binding *b;
+	xcb_keysym_t keysym;
+	uint16_t mods;
+	int mode, err;
+	char key[KEYS_CMD_SIZE];
+
+	if (!args[0] || !args[1])
+		return IPC_ERR_TOO_FEW_ARGS;
+	mode = parse_mode(args[0]);
+	if (mode < 0)
+		return IPC_ERR_SYNTAX;
+	if (strlen(args[1]) >= sizeof(key))
+		return IPC_ERR_ARG_TOO_LARGE;
+	strcpy(key, args[1]);
+	err = parse_key(key, &mods, &keysym);
+	if (err != IPC_ERR_NONE)
+		return err;
+
+	b = find_binding(mode, mods, keysym);
+	if (b) {
+		b->used = false;
+		keys_grab();
+	}
+	return IPC_ERR_NONE;
+}
+
+/**
+ * @brief Find the modifier that Num Lock is mapped to, so that it can be
+ * ignored along with Caps Lock.
+ */
+static void update_numlock(void)
+{
+	xcb_get_modifier_mapping_reply_t *r;
+	xcb_keycode_t *codes, *num, *n;
+	unsigned int i, j;
+
+	numlockmask = 0;
+	r = xcb_get_modifier_mapping_reply(dpy, xcb_get_modifier_mapping(dpy), NULL);
+	if (!r)
+		return;
+	num = xcb_key_symbols_get_keycode(syms, XK_Num_Lock);
+	if (num) {
+		codes = xcb_get_modifier_mapping_keycodes(r);
+		for (i = 0; i < 8; i++)
+			for (j = 0; j < r->keycodes_per_modifier; j++)
+				for (n = num; *n != XCB_NO_SYMBOL; n++)
+					if (codes[i * r->keycodes_per_modifier + j] == *n)
+						numlockmask = 1 << i;
+		free(num);
+	}
+	free(r);
+}
+
+/**
+ * @brief Grab the keys that are bound in the current mode, releasing any
+ * others.
+ *
+ * Each key is grabbed with every combination of Caps Lock and Num Lock, so
+ * that bindings work whether or not they are on.
+ */
+void keys_grab(void)
+{
+	const uint16_t locks[] = { 0, XCB_MOD_MASK_LOCK, numlockmask,
+		numlockmask | XCB_MOD_MASK_LOCK };
+	xcb_keycode_t *codes, *c;
+	unsigned int i, j;
+
+	if (!syms)
+		return;
+	xcb_ungrab_key(dpy, XCB_GRAB_ANY, screen->root, XCB_MOD_MASK_ANY);
+	for (i = 0; i < LENGTH(bindings); i++) {
+		if (!bindings[i].used || (bindings[i].mode != cur_mode
+					&& bindings[i].mode != ALL_MODES))
+			continue;
+		codes = xcb_key_symbols_get_keycode(syms, bindings[i].keysym);
+		if (!codes)
+			continue;
+		for (c = codes; *c != XCB_NO_SYMBOL; c++)
+			for (j = 0; j < LENGTH(locks); j++)
+				if (j < 2 || numlockmask)
+					xcb_grab_key(dpy, true, screen->root,
+							bindings[i].mods | locks[j], *c,
+							XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+		free(codes);
+	}
+}
+
+/**
+ * @brief Run the command bound to a key that has been pressed.
+ *
+ * @param ke The key press event.
+ */
+void keys_press(xcb_key_press_event_t *ke)
+{
+	struct binding *b;
+	xcb_keysym_t keysym;
+	uint16_t mods;
+	int err;
+
+	if (!syms)
+		return;
+	keysym = xcb_key_symbols_get_keysym(syms, ke->detail, 0);
+	mods = ke->state & ~(numlockmask | XCB_MOD_MASK_LOCK) & MODS_MASK;
+	b = find_binding(cur_mode, mods, keysym);
+	if (!b)
+		b = find_binding(ALL_MODES, mods, keysym);
+	if (!b)
+		return;
+
+	/* Count the command's requests against the command itself, as if it had
+	 * arrived over IPC. */
+	xstats_end();
+	err = ipc_command_run(b->opcode, b->args);
+	if (err != IPC_ERR_NONE)
+		log_warn("Bound command %s failed with error %d",
+				ipc_command_name(b->opcode), err);
+}
+
+/**
+ * @brief Update the keyboard mapping when it changes, grabbing keys again as
+ * their keycodes may have changed.
+ *
+ * @param me The mapping notify event.
+ */
+void keys_mapping(xcb_mapping_notify_event_t *me)
+{
+	if (!syms || me->request == XCB_MAPPING_POINTER)
+		return;
+	xcb_refresh_keyboard_mapping(syms, me);
+	update_numlock();
+	keys_grab();
+}
+
+/**
+ * @brief Release the grabbed keys and the keyboard mapping.
+ */
+void keys_cleanup(void)
+{
+	if (!syms)
+		return;
+	xcb_ungrab_key(dpy, XCB_GRAB_ANY, screen->root, XCB_MOD_MASK_ANY);
+	xcb_key_symbols_free(syms);
+	syms = NULL;
+}
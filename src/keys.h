@@ -0,0 +1,30 @@
+#ifndef KEYS_H
+#define KEYS_H
+
+#include <xcb/xcb.h>
+
+/**
+ * @file keys.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/** The most key bindings that can exist at once, across every mode. */
+#define KEYS_MAX_BINDINGS 128
+/** The space for a binding's command and its args, including NULLs. */
+#define KEYS_CMD_SIZE 128
+/** The most args that a bound command can take. */
+#define KEYS_MAX_ARGS 8
+
+int keys_bind(char **args);
+int keys_unbind(char **args);
+void keys_grab(void);
+void keys_press(xcb_key_press_event_t *ke);
+void keys_mapping(xcb_mapping_notify_event_t *me);
+void keys_cleanup(void);
+
+#endif
@@ -4,6 +4,7 @@
 #include "howm.h"
 #include "client.h"
 #include "xcb_help.h"
+#include "probes.h"
 
 /**
  * @file layout.c
@@ -27,16 +28,30 @@ void(*layout_handler[]) (void) = {
 	[VSTACK] = stack
 };
 
+/** How many times each layout has arranged a workspace. */
+static unsigned int passes[END_LAYOUT];
+/** How many callers have deferred arranging, see arrange_defer(). */
+static unsigned int defer_depth;
+/** The redraws that were asked for whilst deferred, from redraws. */
+static unsigned int pending;
+
 /**
  * @brief Call the appropriate layout handler for each layout.
  */
 void arrange_windows(void)
 {
+	int layout;
+
 	if (!wss[cw].head)
 		return;
+	if (arrange_deferred(REDRAW_ARRANGE))
+		return;
 	log_debug("Arranging windows");
-	layout_handler[wss[cw].head->next ? wss[cw].layout : ZOOM]();
-	howm_info();
+	PROBE3(arrange_start, cw, wss[cw].client_cnt, wss[cw].layout);
+	layout = wss[cw].head->next ? wss[cw].layout : ZOOM;
+	passes[layout]++;
+	layout_handler[layout]();
+	PROBE3(arrange_done, cw, wss[cw].client_cnt, wss[cw].layout);
 }
 
 /**
@@ -51,6 +66,7 @@ static void grid(void)
 	uint16_t client_y = conf.bar_bottom ? 0 : wss[cw].bar_height;
 	uint16_t col_h = screen_height - wss[cw].bar_height;
 
+	PROBE2(grid, cw, n);
 	if (n <= 1) {
 		zoom();
 		return;
@@ -91,6 +107,7 @@ static void zoom(void)
 {
 	Client *c;
 
+	PROBE2(zoom, cw, wss[cw].client_cnt);
 	log_info("Arranging clients in zoom format");
 	/* When zoom is called because there aren't enough clients for other
 	 * layouts to work, draw a border to be consistent with other layouts.
@@ -141,6 +158,7 @@ static void stack(void)
 	 */
 	uint16_t span = vert ? h : w;
 
+	PROBE2(stack, cw, n);
 	if (n <= 1) {
 		zoom();
 		return;
@@ -228,3 +246,63 @@ void last_layout(void)
 	change_layout(previous_layout);
 }
 
+
+/**
+ * @brief Get how many times a layout has arranged a workspace.
+ *
+ * @param layout The layout, from enum layouts.
+ */
+unsigned int layout_passes(int layout)
+{
+	return layout >= 0 && layout < END_LAYOUT ? passes[layout] : 0;
+}
+
+/**
+ * @brief Defer arranging windows until arrange_flush() is called.
+ *
+ * Commands that act on several clients (such as an operator with a count)
+ * arrange the workspace after every step, as do runs of commands such as a
+ * held key that moves a floating client. Whilst deferred, drawing, arranging
+ * and the X side of focusing a client are skipped, leaving only changes to
+ * howm's state, and are done once for whichever workspace is current at the
+ * end. Calls may be nested.
+ */
+void arrange_defer(void)
+{
+	defer_depth++;
+}
+
+/**
+ * @brief End a call of arrange_defer(), redrawing as much as was asked for in
+ * the meantime.
+ */
+void arrange_flush(void)
+{
+	unsigned int redraw = pending;
+
+	if (!defer_depth || --defer_depth)
+		return;
+	pending = 0;
+	/* Focusing arranges, which draws. */
+	if (redraw & REDRAW_FOCUS && wss[cw].current)
+		update_focused_client(wss[cw].current);
+	else if (redraw & (REDRAW_FOCUS | REDRAW_ARRANGE))
+		arrange_windows();
+	else if (redraw & REDRAW_DRAW)
+		draw_clients();
+}
+
+/**
+ * @brief Check whether a redraw should be skipped, as it has been deferred.
+ *
+ * @param redraw The redraw that is about to be done, from redraws.
+ *
+ * @return True if the redraw has been deferred until arrange_flush().
+ */
+bool arrange_deferred(unsigned int redraw)
+{
+	if (!defer_depth)
+		return false;
+	pending |= redraw;
+	return true;
+}
@@ -1,6 +1,8 @@
 #ifndef LAYOUT_H
 #define LAYOUT_H
 
+#include <stdbool.h>
+
 /**
  * @file layout.h
  *
@@ -12,11 +14,17 @@
  */
 
 enum layouts { ZOOM, GRID, HSTACK, VSTACK, END_LAYOUT };
+/** The work that can be deferred by arrange_defer(). */
+enum redraws { REDRAW_DRAW = 1, REDRAW_ARRANGE = 2, REDRAW_FOCUS = 4 };
 
 void arrange_windows(void);
 void change_layout(const int layout);
 void next_layout(void);
 void prev_layout(void);
 void last_layout(void);
+unsigned int layout_passes(int layout);
+void arrange_defer(void);
+void arrange_flush(void);
+bool arrange_deferred(unsigned int redraw);
 
 #endif
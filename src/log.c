@@ -0,0 +1,339 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "helper.h"
+
+/**
+ * @file log.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm's logger.
+ *
+ * Logging a message doesn't format or write anything. Instead, the format
+ * string and the raw args are copied into a preallocated ring of records.
+ * The ring is formatted and written to stderr in one go by log_flush(), which
+ * is called when the main loop is about to sleep and when howm exits.
+ *
+ * String args are copied into the record, as they may not outlive the call.
+ * If the ring is full, records are dropped and the amount that were dropped is
+ * reported by the next flush.
+ */
+
+/** The size of the buffer that formatted records are written into. */
+#define LOG_OUT_SIZE 8192
+
+/** A raw arg, stored as the type that it was promoted to. */
+union log_arg {
+	long long i;
+	unsigned long long u;
+	double d;
+	const void *p;
+};
+
+/** A message that is waiting to be formatted. */
+struct log_record {
+	const char *fmt; /**< The format string, which is a string literal. */
+	const char *file; /**< Where the message was logged. */
+	int line; /**< The line that the message was logged on. */
+	unsigned int level; /**< The severity of the message. */
+	bool ready; /**< Has the record been completely filled in? */
+	union log_arg args[LOG_MAX_ARGS]; /**< The args, in order. */
+	char strs[LOG_STR_SIZE]; /**< Copies of any string args. */
+};
+
+/** The length modifiers that matter when fetching an arg. */
+enum log_lengths { LEN_NONE, LEN_LONG, LEN_LLONG, LEN_SIZE };
+
+/** A single conversion specification, such as "%-5lu". */
+struct log_spec {
+	const char *start; /**< The '%' that starts the specification. */
+	size_t len; /**< The length of the specification. */
+	size_t flags_len; /**< The length of the '%', flags, width and precision. */
+	int length; /**< The length modifier, from log_lengths. */
+	char conv; /**< The conversion character, such as 'd'. */
+};
+
+static const char *level_names[] = { "", "[DEBUG]", "[INFO]", "[WARN]", "[ERROR]" };
+
+static struct log_record ring[LOG_RING_SIZE];
+static unsigned int head;
+static unsigned int tail;
+static unsigned int dropped;
+static bool lock;
+static char out[LOG_OUT_SIZE];
+static size_t out_len;
+
+static const char *log_parse_spec(const char *f, struct log_spec *spec);
+
+/**
+ * @brief Make sure that everything that has been logged is written before
+ * howm exits.
+ */
+void log_init(void)
+{
+	atexit(log_flush);
+}
+
+/**
+ * @brief Store a message in the ring, to be formatted later.
+ *
+ * This is normally called by the log_* macros, once the runtime log level has
+ * been checked. It is safe to call from any thread.
+ *
+ * @param level The severity of the message.
+ * @param file The file that the message was logged from.
+ * @param line The line that the message was logged from.
+ * @param fmt A printf style format string. It must outlive the record, which
+ * is always the case for string literals.
+ */
+void log_write(unsigned int level, const char *file, int line, const char *fmt, ...)
+{
+	struct log_record *r;
+	struct log_spec spec;
+	const char *f, *s;
+	unsigned int argc = 0;
+	size_t used = 0, n;
+	va_list ap;
+
+	while (__atomic_test_and_set(&lock, __ATOMIC_ACQUIRE))
+		;
+	if (head - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE) {
+		dropped++;
+		__atomic_clear(&lock, __ATOMIC_RELEASE);
+		return;
+	}
+	r = &ring[head++ % LOG_RING_SIZE];
+	__atomic_clear(&lock, __ATOMIC_RELEASE);
+
+	r->fmt = fmt;
+	r->file = file;
+	r->line = line;
+	r->level = level;
+
+	va_start(ap, fmt);
+	for (f = fmt; (f = strchr(f, '%')) && argc < LOG_MAX_ARGS;) {
+		f = log_parse_spec(f, &spec);
+		switch (spec.conv) {
+		case 'd':
+		case 'i':
+			r->args[argc++].i = spec.length == LEN_LLONG ? va_arg(ap, long long)
+				: spec.length == LEN_LONG ? va_arg(ap, long)
+				: spec.length == LEN_SIZE ? (long long)va_arg(ap, size_t)
+				: va_arg(ap, int);
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+		case 'c':
+			r->args[argc++].u = spec.length == LEN_LLONG ? va_arg(ap, unsigned long long)
+				: spec.length == LEN_LONG ? va_arg(ap, unsigned long)
+				: spec.length == LEN_SIZE ? va_arg(ap, size_t)
+				: va_arg(ap, unsigned int);
+			break;
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+			r->args[argc++].d = va_arg(ap, double);
+			break;
+		case 'p':
+			r->args[argc++].p = va_arg(ap, void *);
+			break;
+		case 's':
+			s = va_arg(ap, const char *);
+			/* Once strs is full, any remaining strings are left out. */
+			if (used == LOG_STR_SIZE) {
+				r->args[argc++].p = "";
+				break;
+			}
+			s = s ? s : "(null)";
+			n = strlen(s);
+			if (n > LOG_STR_SIZE - used - 1)
+				n = LOG_STR_SIZE - used - 1;
+			memcpy(r->strs + used, s, n);
+			r->strs[used + n] = '\0';
+			r->args[argc++].p = r->strs + used;
+			used += n + 1;
+			break;
+		default:
+			break;
+		}
+	}
+	va_end(ap);
+
+	__atomic_store_n(&r->ready, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Parse a conversion specification.
+ *
+ * Flags, widths and precisions are supported, but not when given as '*'.
+ *
+ * @param f A pointer to the '%' that starts the specification.
+ * @param spec Where the parsed specification is stored.
+ *
+ * @return A pointer to the character after the specification.
+ */
+static const char *log_parse_spec(const char *f, struct log_spec *spec)
+{
+	spec->start = f++;
+	spec->length = LEN_NONE;
+	f += strspn(f, "-+ #0123456789.");
+	spec->flags_len = f - spec->start;
+	if (*f == 'l' && *(f + 1) == 'l') {
+		spec->length = LEN_LLONG;
+		f += 2;
+	} else if (*f == 'l' || *f == 'j' || *f == 't') {
+		spec->length = LEN_LONG;
+		f++;
+	} else if (*f == 'z') {
+		spec->length = LEN_SIZE;
+		f++;
+	} else {
+		f += strspn(f, "hL");
+	}
+	spec->conv = *f;
+	if (*f)
+		f++;
+	spec->len = f - spec->start;
+	return f;
+}
+
+/**
+ * @brief Append formatted text to the output buffer.
+ */
+static void out_printf(const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (out_len >= LOG_OUT_SIZE)
+		return;
+	va_start(ap, fmt);
+	n = vsnprintf(out + out_len, LOG_OUT_SIZE - out_len, fmt, ap);
+	va_end(ap);
+	if (n > 0)
+		out_len += (size_t)n < LOG_OUT_SIZE - out_len ? (size_t)n : LOG_OUT_SIZE - out_len - 1;
+}
+
+static void out_write(void)
+{
+	size_t off = 0;
+	ssize_t n;
+
+	while (off < out_len) {
+		n = write(STDERR_FILENO, out + off, out_len - off);
+		if (n <= 0)
+			break;
+		off += n;
+	}
+	out_len = 0;
+}
+
+/**
+ * @brief Format a record and append it to the output buffer.
+ *
+ * @param r The record to be formatted.
+ */
+static void log_format(const struct log_record *r)
+{
+	struct log_spec spec;
+	const char *f = r->fmt, *next;
+	char conv[16];
+	unsigned int argc = 0;
+
+	out_printf("%s (%s:%d) ", level_names[r->level < LENGTH(level_names) ? r->level : 0],
+			r->file, r->line);
+	while ((next = strchr(f, '%'))) {
+		out_printf("%.*s", (int)(next - f), f);
+		f = log_parse_spec(next, &spec);
+		if (spec.conv == '%') {
+			out_printf("%%");
+			continue;
+		}
+		if (argc >= LOG_MAX_ARGS || spec.len + 3 > sizeof(conv)) {
+			out_printf("%.*s", (int)spec.len, spec.start);
+			continue;
+		}
+		memcpy(conv, spec.start, spec.len);
+		conv[spec.len] = '\0';
+		switch (spec.conv) {
+		case 'd':
+		case 'i':
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+			/* Integers are stored widened, so widen the conversion too. */
+			memcpy(conv + spec.flags_len, "ll", 2);
+			conv[spec.flags_len + 2] = spec.conv;
+			conv[spec.flags_len + 3] = '\0';
+			if (spec.conv == 'd' || spec.conv == 'i')
+				out_printf(conv, r->args[argc].i);
+			else
+				out_printf(conv, r->args[argc].u);
+			break;
+		case 'c':
+			out_printf(conv, (int)r->args[argc].u);
+			break;
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+			out_printf(conv, r->args[argc].d);
+			break;
+		case 'p':
+		case 's':
+			out_printf(conv, r->args[argc].p);
+			break;
+		default:
+			out_printf("%s", conv);
+			continue;
+		}
+		argc++;
+	}
+	out_printf("%s\n", f);
+}
+
+/**
+ * @brief Format and write every record that is waiting in the ring.
+ *
+ * Records are written to stderr with as few writes as possible. This must
+ * only be called from the main thread.
+ */
+void log_flush(void)
+{
+	struct log_record *r;
+	unsigned int lost;
+
+	for (;;) {
+		r = &ring[tail % LOG_RING_SIZE];
+		if (!__atomic_load_n(&r->ready, __ATOMIC_ACQUIRE))
+			break;
+		if (out_len > LOG_OUT_SIZE / 2)
+			out_write();
+		log_format(r);
+		r->ready = false;
+		__atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE);
+	}
+
+	lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+	if (lost)
+		out_printf("[WARN] (%s:%d) Dropped %u log messages\n", __FILE__, __LINE__, lost);
+	if (out_len)
+		out_write();
+}
@@ -0,0 +1,26 @@
+#ifndef LOG_H
+#define LOG_H
+
+/**
+ * @file log.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/** The amount of records that can be waiting to be written. */
+#define LOG_RING_SIZE 512
+/** The most args that a single record can hold. */
+#define LOG_MAX_ARGS 8
+/** Space in each record for copies of string args. */
+#define LOG_STR_SIZE 96
+
+void log_init(void);
+void log_write(unsigned int level, const char *file, int line, const char *fmt, ...)
+	__attribute__((format(printf, 4, 5)));
+void log_flush(void);
+
+#endif
@@ -0,0 +1,95 @@
+#define _POSIX_C_SOURCE 200809L
+#include <sys/resource.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "mem.h"
+
+/**
+ * @file mem.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Account for the memory that howm allocates, so that leaks show up as
+ * growth that never goes away.
+ */
+
+static struct mem_counter counters[MEM_COUNTERS_END];
+
+static const char *counter_names[MEM_COUNTERS_END] = {
+	[MEM_CLIENTS] = "clients",
+};
+
+/**
+ * @brief Count an allocation.
+ *
+ * @param counter The kind of allocation, from mem_counters.
+ */
+void mem_alloc(unsigned int counter)
+{
+	struct mem_counter *c = &counters[counter];
+
+	c->total++;
+	if (++c->live > c->peak)
+		c->peak = c->live;
+}
+
+/**
+ * @brief Count an allocation being freed.
+ *
+ * @param counter The kind of allocation, from mem_counters.
+ */
+void mem_free(unsigned int counter)
+{
+	if (counters[counter].live > 0)
+		counters[counter].live--;
+}
+
+const struct mem_counter *mem_get(unsigned int counter)
+{
+	return &counters[counter];
+}
+
+const char *mem_counter_name(unsigned int counter)
+{
+	return counter < MEM_COUNTERS_END ? counter_names[counter] : NULL;
+}
+
+/**
+ * @brief Find out how much memory howm is using.
+ *
+ * The current resident set size is read from /proc, so it is only available on
+ * Linux. The peak is available wherever getrusage() is.
+ *
+ * @param rss_kb Set to the current resident set size in KiB, or 0.
+ * @param peak_rss_kb Set to the peak resident set size in KiB.
+ *
+ * @return False if neither could be found.
+ */
+bool mem_rss(uint64_t *rss_kb, uint64_t *peak_rss_kb)
+{
+	struct rusage ru;
+	unsigned long pages, resident;
+	FILE *f;
+	bool ok = false;
+
+	*rss_kb = *peak_rss_kb = 0;
+	if (getrusage(RUSAGE_SELF, &ru) == 0) {
+		*peak_rss_kb = ru.ru_maxrss;
+		ok = true;
+	}
+	f = fopen("/proc/self/statm", "r");
+	if (f) {
+		if (fscanf(f, "%lu %lu", &pages, &resident) == 2) {
+			*rss_kb = (uint64_t)resident * sysconf(_SC_PAGESIZE) / 1024;
+			ok = true;
+		}
+		fclose(f);
+	}
+	/* The peak is only updated now and then, so it can lag behind. */
+	if (*rss_kb > *peak_rss_kb)
+		*peak_rss_kb = *rss_kb;
+	return ok;
+}
@@ -0,0 +1,35 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @file mem.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/** The kinds of allocation that are counted. */
+enum mem_counters { MEM_CLIENTS, MEM_COUNTERS_END };
+
+/**
+ * @brief The allocations of one kind that howm has made.
+ */
+struct mem_counter {
+	uint32_t live; /**< Allocations that haven't been freed. */
+	uint32_t peak; /**< The most allocations that have been live at once. */
+	uint32_t total; /**< Every allocation that has been made. */
+};
+
+void mem_alloc(unsigned int counter);
+void mem_free(unsigned int counter);
+const struct mem_counter *mem_get(unsigned int counter);
+const char *mem_counter_name(unsigned int counter);
+bool mem_rss(uint64_t *rss_kb, uint64_t *peak_rss_kb);
+
+#endif
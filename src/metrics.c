@@ -0,0 +1,394 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metrics.h"
+#include "howm.h"
+#include "helper.h"
+#include "ipc.h"
+#include "layout.h"
+#include "mem.h"
+#include "proc.h"
+#include "scheduler.h"
+#include "xworker.h"
+#include "xlatency.h"
+#include "xstats.h"
+
+/**
+ * @file metrics.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Export howm's counters in the Prometheus text format.
+ *
+ * Every conf.metrics_interval milliseconds, the metrics are rendered into a
+ * buffer on the main thread, which only takes a few microseconds. The buffer
+ * is then handed to a writer thread, which writes it to a temporary file and
+ * renames that over conf.metrics_path, so that a scraper (such as
+ * node_exporter's textfile collector) never sees a partial file and a slow
+ * filesystem never stalls the main loop.
+ */
+
+struct buf {
+	char *data;
+	size_t len;
+	size_t cap;
+};
+
+static const char *layout_names[END_LAYOUT] = {
+	[ZOOM] = "zoom",
+	[GRID] = "grid",
+	[HSTACK] = "hstack",
+	[VSTACK] = "vstack",
+};
+
+static uint64_t iterations;
+static uint64_t next_ms;
+static struct buf render; /**< Only used by the main thread. */
+
+static pthread_t thread;
+static bool started;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+/* The following are protected by lock. */
+static struct buf handoff; /**< Rendered metrics waiting to be written. */
+static char handoff_path[METRICS_PATH_SIZE];
+static bool ready; /**< Does handoff hold metrics that haven't been written? */
+static bool stop;
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void out_printf(struct buf *b, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Append to a buffer, growing it as needed. If memory can't be
+ * allocated, the output is truncated.
+ */
+static void out_printf(struct buf *b, const char *fmt, ...)
+{
+	va_list ap;
+	size_t cap;
+	char *new;
+	int n;
+
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(b->data + b->len, b->cap - b->len, fmt, ap);
+		va_end(ap);
+		if (n < 0)
+			return;
+		if ((size_t)n < b->cap - b->len) {
+			b->len += n;
+			return;
+		}
+		cap = b->cap ? b->cap * 2 : METRICS_BUF_SIZE;
+		while (cap < b->len + n + 1)
+			cap *= 2;
+		new = realloc(b->data, cap);
+		if (!new)
+			return;
+		b->data = new;
+		b->cap = cap;
+	}
+}
+
+static void out_header(struct buf *b, const char *name, const char *type,
+		const char *help)
+{
+	out_printf(b, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/**
+ * @brief Render the operations recorded by xstats, from first up to (but not
+ * including) last.
+ */
+static void render_ops(struct buf *b, unsigned int first, unsigned int last,
+		const char *metric, const char *label)
+{
+	const struct xstats_op *o;
+	const char *name;
+	unsigned int op;
+
+	for (op = first; op < last; op++) {
+		o = xstats_get(op);
+		name = xstats_op_name(op);
+		if (o->calls && name)
+			out_printf(b, "%s{%s=\"%s\"} %u\n", metric, label,
+					name, o->calls);
+	}
+}
+
+static void render_metrics(struct buf *b)
+{
+	const struct xstats_op *o;
+	const struct mem_counter *m;
+	const struct xlatency *x = xlatency_get();
+	const struct sched *s = sched_get();
+	const struct proc_stats *p = proc_get();
+	const struct xworker_stats *xw = xworker_get();
+	uint64_t rss, peak_rss, cumulative = 0;
+	unsigned int i;
+	const char *name;
+
+	b->len = 0;
+	out_header(b, "howm_events_total", "counter", "X events handled, by type.");
+	render_ops(b, IPC_OP_END, XSTATS_OPS, "howm_events_total", "type");
+	out_header(b, "howm_ipc_commands_total", "counter", "IPC commands run, by name.");
+	render_ops(b, XSTATS_OTHER + 1, IPC_OP_END, "howm_ipc_commands_total",
+			"command");
+
+	out_header(b, "howm_layout_passes_total", "counter", "Workspaces arranged, by layout.");
+	for (i = 0; i < END_LAYOUT; i++)
+		out_printf(b, "howm_layout_passes_total{layout=\"%s\"} %u\n",
+				layout_names[i], layout_passes(i));
+
+	out_header(b, "howm_x_requests_total", "counter", "X requests sent, by the operation that sent them.");
+	for (i = 0; i < XSTATS_OPS; i++) {
+		o = xstats_get(i);
+		name = xstats_op_name(i);
+		if (o->requests && name)
+			out_printf(b, "howm_x_requests_total{op=\"%s\"} %u\n", name, o->requests);
+	}
+	out_header(b, "howm_x_round_trips_total", "counter", "Blocking waits for X replies, by the operation that waited.");
+	for (i = 0; i < XSTATS_OPS; i++) {
+		o = xstats_get(i);
+		name = xstats_op_name(i);
+		if (o->round_trips && name)
+			out_printf(b, "howm_x_round_trips_total{op=\"%s\"} %u\n", name, o->round_trips);
+	}
+
+	out_header(b, "howm_x_round_trip_seconds", "histogram", "X server round trip latency, when xlatency_interval is set.");
+	for (i = 0; i < XLATENCY_BUCKETS; i++) {
+		cumulative += x->buckets[i];
+		if (xlatency_bucket_bound(i))
+			out_printf(b, "howm_x_round_trip_seconds_bucket{le=\"%.9g\"} %llu\n",
+					xlatency_bucket_bound(i) / 1e6,
+					(unsigned long long)cumulative);
+		else
+			out_printf(b, "howm_x_round_trip_seconds_bucket{le=\"+Inf\"} %llu\n",
+					(unsigned long long)cumulative);
+	}
+	out_printf(b, "howm_x_round_trip_seconds_sum %.9g\nhowm_x_round_trip_seconds_count %u\n",
+			x->sum_us / 1e6, x->samples);
+
+	out_header(b, "howm_clients", "gauge", "Clients managed, by workspace.");
+	for (i = 1; i <= WORKSPACES; i++)
+		out_printf(b, "howm_clients{workspace=\"%u\"} %d\n", i, wss[i].client_cnt);
+
+	out_header(b, "howm_allocations", "gauge", "Allocations that haven't been freed, by kind.");
+	for (i = 0; i < MEM_COUNTERS_END; i++)
+		out_printf(b, "howm_allocations{kind=\"%s\"} %u\n", mem_counter_name(i), mem_get(i)->live);
+	out_header(b, "howm_allocations_total", "counter", "Allocations made, by kind.");
+	for (i = 0; i < MEM_COUNTERS_END; i++) {
+		m = mem_get(i);
+		out_printf(b, "howm_allocations_total{kind=\"%s\"} %u\n", mem_counter_name(i), m->total);
+	}
+	if (mem_rss(&rss, &peak_rss)) {
+		out_header(b, "howm_resident_memory_bytes", "gauge", "Resident set size.");
+		out_printf(b, "howm_resident_memory_bytes %llu\n", (unsigned long long)rss * 1024);
+	}
+
+	out_header(b, "howm_ipc_queue_depth", "gauge", "IPC messages waiting to be run, by class.");
+	out_printf(b, "howm_ipc_queue_depth{class=\"interactive\"} %u\n",
+			ipc_queue_depth(IPC_CLASS_INTERACTIVE));
+	out_printf(b, "howm_ipc_queue_depth{class=\"bulk\"} %u\n",
+			ipc_queue_depth(IPC_CLASS_BULK));
+	out_header(b, "howm_ipc_queue_depth_max", "gauge", "The most IPC messages that have waited at once, by class.");
+	out_printf(b, "howm_ipc_queue_depth_max{class=\"interactive\"} %u\n",
+			s->max_depth[IPC_CLASS_INTERACTIVE]);
+	out_printf(b, "howm_ipc_queue_depth_max{class=\"bulk\"} %u\n",
+			s->max_depth[IPC_CLASS_BULK]);
+	out_header(b, "howm_sched_runs_total", "counter", "Messages and events run by the scheduler, by source.");
+	for (i = 0; i < SCHED_SOURCES_END; i++)
+		out_printf(b, "howm_sched_runs_total{source=\"%s\"} %llu\n",
+				sched_source_name(i), (unsigned long long)s->done[i]);
+	out_header(b, "howm_sched_backlog_rounds_total", "counter", "Scheduler rounds that left work waiting, by source.");
+	for (i = 0; i < SCHED_SOURCES_END; i++)
+		out_printf(b, "howm_sched_backlog_rounds_total{source=\"%s\"} %llu\n",
+				sched_source_name(i), (unsigned long long)s->backlog[i]);
+	out_header(b, "howm_sched_rounds_total", "counter", "Scheduler rounds that ran any work.");
+	out_printf(b, "howm_sched_rounds_total %llu\n", (unsigned long long)s->rounds);
+
+	out_header(b, "howm_processes_spawned_total", "counter", "Programs started.");
+	out_printf(b, "howm_processes_spawned_total %llu\n", (unsigned long long)p->spawned);
+	out_header(b, "howm_processes_failed_total", "counter", "Programs that couldn't be started.");
+	out_printf(b, "howm_processes_failed_total %llu\n", (unsigned long long)p->failed);
+	out_header(b, "howm_processes", "gauge", "Programs started by howm that haven't been reaped.");
+	out_printf(b, "howm_processes %u\n", p->running);
+
+	out_header(b, "howm_xworker_jobs_total", "counter", "Jobs run by the X worker, by type.");
+	for (i = 0; i < XWORKER_JOBS_END; i++)
+		out_printf(b, "howm_xworker_jobs_total{type=\"%s\"} %llu\n",
+				xworker_job_name(i), (unsigned long long)xw->jobs[i]);
+	out_header(b, "howm_xworker_sync_total", "counter", "X worker jobs run on the main thread instead.");
+	out_printf(b, "howm_xworker_sync_total %llu\n", (unsigned long long)xw->sync);
+	out_header(b, "howm_xworker_cancelled_total", "counter", "X worker jobs whose window was destroyed before they were answered.");
+	out_printf(b, "howm_xworker_cancelled_total %llu\n", (unsigned long long)xw->cancelled);
+
+	out_header(b, "howm_loop_iterations_total", "counter", "Iterations of the main loop.");
+	out_printf(b, "howm_loop_iterations_total %llu\n", (unsigned long long)iterations);
+}
+
+/**
+ * @brief Write a buffer to path, atomically.
+ */
+static void write_file(const char *path, const struct buf *b)
+{
+	char tmp[METRICS_PATH_SIZE + 8];
+	size_t off = 0;
+	ssize_t n;
+	int fd;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		log_warn("Can't open %s for metrics", tmp);
+		return;
+	}
+	while (off < b->len && (n = write(fd, b->data + off, b->len - off)) > 0)
+		off += n;
+	if (close(fd) == -1 || off < b->len) {
+		log_warn("Can't write metrics to %s", tmp);
+		unlink(tmp);
+		return;
+	}
+	if (rename(tmp, path) == -1) {
+		log_warn("Can't rename %s to %s", tmp, path);
+		unlink(tmp);
+	}
+}
+
+static void *metrics_run(void *arg)
+{
+	struct buf writing = { NULL, 0, 0 }, t;
+	char path[METRICS_PATH_SIZE];
+
+	UNUSED(arg);
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		while (!ready && !stop)
+			pthread_cond_wait(&cond, &lock);
+		if (stop)
+			break;
+		t = writing;
+		writing = handoff;
+		handoff = t;
+		memcpy(path, handoff_path, sizeof(path));
+		ready = false;
+		pthread_mutex_unlock(&lock);
+		write_file(path, &writing);
+		pthread_mutex_lock(&lock);
+	}
+	pthread_mutex_unlock(&lock);
+	free(writing.data);
+	return NULL;
+}
+
+/**
+ * @brief Count an iteration of the main loop and, if they are due, hand the
+ * metrics to the writer thread.
+ */
+void metrics_update(void)
+{
+	struct buf t;
+	uint64_t now;
+
+	iterations++;
+	if (!conf.metrics_interval || conf.metrics_path[0] == '\0')
+		return;
+	now = now_ms();
+	if (now < next_ms)
+		return;
+	next_ms = now + conf.metrics_interval;
+
+	if (!started) {
+		if (pthread_create(&thread, NULL, metrics_run, NULL) != 0) {
+			log_err("Can't start the metrics thread");
+			conf.metrics_interval = 0;
+			return;
+		}
+		started = true;
+	}
+	render_metrics(&render);
+	pthread_mutex_lock(&lock);
+	t = handoff;
+	handoff = render;
+	render = t;
+	memcpy(handoff_path, conf.metrics_path, sizeof(handoff_path));
+	ready = true;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * @brief How long the main loop may sleep before the metrics are due.
+ *
+ * @param tv Storage for the timeout.
+ * @param other The timeout that would otherwise be used, or NULL.
+ *
+ * @return Whichever of tv and other is sooner.
+ */
+struct timeval *metrics_timeout(struct timeval *tv, struct timeval *other)
+{
+	uint64_t now = now_ms(), ms;
+
+	if (!conf.metrics_interval || conf.metrics_path[0] == '\0')
+		return other;
+	ms = next_ms > now ? next_ms - now : 0;
+	if (other && (uint64_t)other->tv_sec * 1000 + other->tv_usec / 1000 <= ms)
+		return other;
+	tv->tv_sec = ms / 1000;
+	tv->tv_usec = (ms % 1000) * 1000;
+	return tv;
+}
+
+/**
+ * @brief Render the metrics for an IPC query.
+ *
+ * @param len Set to the length of the metrics.
+ *
+ * @return The metrics, which are valid until the next call of metrics_update
+ * or metrics_render.
+ */
+const char *metrics_render(size_t *len)
+{
+	render_metrics(&render);
+	*len = render.len;
+	return render.data;
+}
+
+/**
+ * @brief Stop the writer thread, letting it finish any write in progress.
+ */
+void metrics_cleanup(void)
+{
+	if (started) {
+		pthread_mutex_lock(&lock);
+		stop = true;
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&lock);
+		pthread_join(thread, NULL);
+		started = false;
+	}
+	free(render.data);
+	free(handoff.data);
+	render.data = handoff.data = NULL;
+	render.len = render.cap = handoff.len = handoff.cap = 0;
+}
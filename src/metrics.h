@@ -0,0 +1,25 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <sys/time.h>
+
+/**
+ * @file metrics.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/** The initial size of a metrics buffer. */
+#define METRICS_BUF_SIZE 16384
+
+void metrics_update(void);
+struct timeval *metrics_timeout(struct timeval *tv, struct timeval *other);
+const char *metrics_render(size_t *len);
+void metrics_cleanup(void);
+
+#endif
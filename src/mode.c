@@ -1,6 +1,7 @@
 #include "helper.h"
 #include "howm.h"
 #include "mode.h"
+#include "keys.h"
 
 /**
  * @brief Change the mode of howm.
@@ -18,5 +19,5 @@ void change_mode(const int mode)
 		return;
 	cur_mode = mode;
 	log_info("Changing to mode %d", cur_mode);
-	howm_info();
+	keys_grab();
 }
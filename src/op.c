@@ -6,6 +6,10 @@
 #include "helper.h"
 #include "scratchpad.h"
 #include "types.h"
+#include "xstats.h"
+#include "layout.h"
+#include "mode.h"
+#include "ipc.h"
 
 /**
  * @file op.c
@@ -17,8 +21,28 @@
  * @brief All of howm's operators are implemented here.
  */
 
+/** The largest count that an operator expression may have. */
+#define OP_MAX_COUNT 99
+
 static int cur_cnt = 1;
 
+/* The keys of the default keybindings, which operator expressions use. These
+ * don't follow the user's keybindings. */
+static const struct {
+	char key;
+	unsigned int mode; /**< The mode the key is bound in, from modes. */
+	void (*func)(const unsigned int type, int cnt);
+} op_keys[] = {
+	{ 'q', NORMAL, op_kill },
+	{ 'j', NORMAL, op_move_down },
+	{ 'k', NORMAL, op_move_up },
+	{ 'g', NORMAL, op_shrink_gaps },
+	{ 'G', NORMAL, op_grow_gaps },
+	{ 'd', NORMAL, op_cut },
+	{ 'j', FOCUS, op_focus_down },
+	{ 'k', FOCUS, op_focus_up },
+};
+
 static void change_gaps(const unsigned int type, int cnt, int size);
 
 /**
@@ -168,6 +192,7 @@ static void change_gaps(const unsigned int type, int cnt, int size)
 			cnt--;
 		}
 	}
+	draw_clients();
 }
 
 /**
@@ -303,8 +328,72 @@ void motion(char *target)
 	else
 		return;
 
+	arrange_defer();
 	operator_func(type, cur_cnt);
+	arrange_flush();
 	cur_state = OPERATOR_STATE;
 	/* Reset so that qc is equivalent to q1c. */
 	cur_cnt = 1;
 }
+
+/**
+ * @brief Apply a whole operator expression, such as q3c, in one go.
+ *
+ * An expression is an operator's key, an optional count and a motion. The
+ * keys are fixed in op_keys, matching the default keybindings rather than the
+ * user's: q (kill), j and k (move down and up), g and G (shrink and grow gaps)
+ * and d (cut) in normal mode, j and k (focus down and up) in focus mode. The
+ * count is between 1 and OP_MAX_COUNT and the motion is c (clients) or w
+ * (workspaces), so d5c cuts 5 clients. Unlike sending an
+ * operator, a count and a motion separately, this doesn't depend on (or
+ * change) the state of a partially entered operator. The windows are
+ * arranged once, after the operator has finished.
+ *
+ * @param args The expression is the first arg.
+ *
+ * @return IPC_ERR_SYNTAX if the key isn't bound in the current mode or the
+ * count or motion is invalid, otherwise IPC_ERR_NONE.
+ *
+ * @ingroup commands
+ */
+int operate(char **args)
+{
+	void (*func)(const unsigned int type, int cnt) = NULL;
+	const char *e = *args, *digits;
+	unsigned int i;
+	int cnt = 0, type;
+
+	for (i = 0; i < LENGTH(op_keys); i++)
+		if (op_keys[i].key == *e && op_keys[i].mode == cur_mode)
+			func = op_keys[i].func;
+	if (!func) {
+		log_warn("Unknown operator in <%s>", *args);
+		return IPC_ERR_SYNTAX;
+	}
+
+	for (digits = ++e; *e >= '0' && *e <= '9' && cnt <= OP_MAX_COUNT; e++)
+		cnt = cnt * 10 + *e - '0';
+	if (e == digits) {
+		cnt = 1;
+	} else if (cnt < 1 || cnt > OP_MAX_COUNT) {
+		log_warn("Count in <%s> isn't between 1 and %d", *args, OP_MAX_COUNT);
+		return IPC_ERR_SYNTAX;
+	}
+
+	if (*e == 'c')
+		type = CLIENT;
+	else if (*e == 'w')
+		type = WORKSPACE;
+	else
+		e = NULL;
+	if (!e || *(e + 1) != '\0') {
+		log_warn("Invalid motion in <%s>", *args);
+		return IPC_ERR_SYNTAX;
+	}
+
+	log_info("Applying operator expression <%s>", *args);
+	arrange_defer();
+	func(type, cnt);
+	arrange_flush();
+	return IPC_ERR_NONE;
+}
@@ -27,5 +27,6 @@ void op_grow_gaps(const unsigned int type, int cnt);
 void op_cut(const unsigned int type, int cnt);
 void count(const int cnt);
 void motion(char *target);
+int operate(char **args);
 
 #endif
@@ -0,0 +1,49 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/**
+ * @file probes.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/* USDT probes on howm's hot paths, for use with bpftrace, perf or SystemTap.
+ * They are compiled in when HAVE_SDT is defined, which the Makefile does when
+ * <sys/sdt.h> is available. A probe that nothing is attached to is a single
+ * nop, so they are left in release builds.
+ *
+ * Probes that end in _start and _done surround a piece of work, so that it can
+ * be timed. Their args are:
+ *
+ * event_start, event_done: event type, workspace, client count, window
+ * ipc_start: message type
+ * ipc_done: message type, error code
+ * arrange_start, arrange_done: workspace, client count, layout
+ * draw_start, draw_done: workspace, client count
+ * change_ws_start, change_ws_done: old workspace, new workspace, client count
+ * grid, zoom, stack: workspace, client count
+ * focus: workspace, client count, window
+ * client_create, client_remove: workspace, client count, window
+ * xlatency: X server round trip in microseconds, requests not yet processed
+ *
+ * When a window isn't known, it is 0. */
+
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+
+#define PROBE1(name, a) DTRACE_PROBE1(howm, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(howm, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(howm, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(howm, name, a, b, c, d)
+#else
+#define PROBE1(name, a) do { } while (0)
+#define PROBE2(name, a, b) do { } while (0)
+#define PROBE3(name, a, b, c) do { } while (0)
+#define PROBE4(name, a, b, c, d) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,190 @@
+#define _GNU_SOURCE
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "proc.h"
+#include "howm.h"
+#include "helper.h"
+
+/**
+ * @file proc.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Start programs and reap them once they exit.
+ *
+ * Programs are started with posix_spawn(), which glibc implements with
+ * clone(CLONE_VM | CLONE_VFORK), so starting one doesn't copy howm's page
+ * tables and takes the same time no matter how much memory howm uses. Every
+ * file descriptor that howm opens is close-on-exec, so a program never
+ * inherits the X connection or an IPC socket.
+ *
+ * SIGCHLD is blocked and read from a signalfd in the main loop instead, so
+ * that exited programs are reaped without a signal handler interrupting
+ * howm. Signals of the same type are merged whilst pending, so every exited
+ * child is reaped each time the signalfd becomes readable.
+ */
+
+extern char **environ;
+
+static int fd = -1;
+static sigset_t old_mask;
+static struct proc_stats stats;
+
+/**
+ * @brief Reap every child that has exited.
+ */
+static void proc_reap(void)
+{
+	pid_t pid;
+	int status;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		stats.reaped++;
+		if (stats.running > 0)
+			stats.running--;
+		if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+			log_info("Process %d exited with status %d", pid,
+					WEXITSTATUS(status));
+		else if (WIFSIGNALED(status))
+			log_info("Process %d was killed by signal %d", pid,
+					WTERMSIG(status));
+	}
+}
+
+/**
+ * @brief Block SIGCHLD and start reading it from a signalfd.
+ *
+ * This must be called before any threads are started, so that they inherit
+ * the blocked signal and SIGCHLD can't be delivered to them instead.
+ */
+void proc_init(void)
+{
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	if (sigprocmask(SIG_BLOCK, &mask, &old_mask) == -1) {
+		log_err("Can't block SIGCHLD, exited programs won't be reaped");
+		return;
+	}
+	fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd == -1)
+		log_err("Can't create a signalfd, exited programs won't be reaped");
+	/* Children from before a restart may have exited whilst SIGCHLD wasn't
+	 * being read. */
+	proc_reap();
+}
+
+/**
+ * @brief Start a program in its own session.
+ *
+ * The program gets howm's environment and a clean signal mask and
+ * dispositions, rather than howm's blocked SIGCHLD.
+ *
+ * @param argv The program and its args, terminated by NULL.
+ * @param search Should the program be searched for in PATH?
+ *
+ * @return True if the program was started.
+ */
+bool proc_spawn(char *const argv[], bool search)
+{
+	posix_spawnattr_t attr;
+	sigset_t mask;
+	short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+	pid_t pid;
+	int err;
+
+	if ((err = posix_spawnattr_init(&attr)) != 0) {
+		log_err("Can't start %s: %s", argv[0], strerror(err));
+		stats.failed++;
+		return false;
+	}
+#ifdef POSIX_SPAWN_SETSID
+	flags |= POSIX_SPAWN_SETSID;
+#else
+	flags |= POSIX_SPAWN_SETPGROUP;
+	posix_spawnattr_setpgroup(&attr, 0);
+#endif
+	posix_spawnattr_setflags(&attr, flags);
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &mask);
+
+	if (search)
+		err = posix_spawnp(&pid, argv[0], NULL, &attr, argv, environ);
+	else
+		err = posix_spawn(&pid, argv[0], NULL, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+
+	if (err != 0) {
+		log_err("Can't start %s: %s", argv[0], strerror(err));
+		stats.failed++;
+		return false;
+	}
+	log_info("Started %s as process %d", argv[0], pid);
+	stats.spawned++;
+	stats.running++;
+	return true;
+}
+
+/**
+ * @brief Add the signalfd to a set of file descriptors.
+ *
+ * @param descs The set that will be passed to select.
+ * @param max_fd The current value of the highest fd plus one.
+ *
+ * @return The new value of the highest fd plus one.
+ */
+int proc_set_fds(fd_set *descs, int max_fd)
+{
+	if (fd == -1)
+		return max_fd;
+	FD_SET(fd, descs);
+	return MAX_FD(fd, max_fd - 1);
+}
+
+/**
+ * @brief Reap exited children, if select has marked the signalfd as readable.
+ *
+ * @param descs The set of file descriptors returned by select.
+ */
+void proc_handle_fds(fd_set *descs)
+{
+	struct signalfd_siginfo info[8];
+
+	if (fd == -1 || !FD_ISSET(fd, descs))
+		return;
+	while (read(fd, info, sizeof(info)) > 0)
+		;
+	proc_reap();
+}
+
+/**
+ * @brief Get the amount of processes that howm has started and reaped.
+ */
+const struct proc_stats *proc_get(void)
+{
+	return &stats;
+}
+
+/**
+ * @brief Stop reading SIGCHLD and restore the signal mask.
+ */
+void proc_cleanup(void)
+{
+	if (fd != -1)
+		close(fd);
+	fd = -1;
+	sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
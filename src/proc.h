@@ -0,0 +1,35 @@
+#ifndef PROC_H
+#define PROC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/select.h>
+
+/**
+ * @file proc.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/**
+ * @brief The processes that howm has started.
+ */
+struct proc_stats {
+	uint64_t spawned; /**< Processes started. */
+	uint64_t failed; /**< Processes that couldn't be started. */
+	uint64_t reaped; /**< Processes that have exited and been reaped. */
+	uint32_t running; /**< Processes that are yet to be reaped. */
+};
+
+void proc_init(void);
+bool proc_spawn(char *const argv[], bool search);
+int proc_set_fds(fd_set *descs, int max_fd);
+void proc_handle_fds(fd_set *descs);
+const struct proc_stats *proc_get(void);
+void proc_cleanup(void);
+
+#endif
@@ -0,0 +1,644 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "query.h"
+#include "ipc.h"
+#include "howm.h"
+#include "helper.h"
+#include "scratchpad.h"
+#include "xstats.h"
+#include "startup.h"
+#include "mem.h"
+#include "xlatency.h"
+#include "metrics.h"
+
+/**
+ * @file query.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Answer queries about howm's state.
+ *
+ * The whole reply is serialised into a single buffer that is reused between
+ * queries. It is sized before serialisation starts, so no memory is allocated
+ * per field (or at all, once the buffer is large enough).
+ */
+
+/** The initial size of the reply buffer. */
+#define QUERY_BUF_SIZE 4096
+/** A generous upper bound of the size of a serialised client. */
+#define QUERY_CLIENT_SIZE 160
+/** A generous upper bound of the size of everything but the clients. */
+#define QUERY_FIXED_SIZE (512 + WORKSPACES * 256)
+/** A generous upper bound of the size of an operation's X request counts. */
+#define QUERY_XSTATS_OP_SIZE 384
+/** A generous upper bound of the size of a single request opcode's count. */
+#define QUERY_XSTATS_OPCODE_SIZE 48
+/** A generous upper bound of the size of a startup mark. */
+#define QUERY_STARTUP_MARK_SIZE 96
+/** A generous upper bound of the size of the memory report. */
+#define QUERY_MEMORY_SIZE (512 + MEM_COUNTERS_END * 96)
+/** A generous upper bound of the size of the X latency report. */
+#define QUERY_XLATENCY_SIZE (512 + XLATENCY_BUCKETS * 48)
+
+static struct {
+	char *data; /**< The serialised reply. */
+	size_t len; /**< The length of the reply. */
+	size_t cap; /**< The amount of memory allocated for data. */
+} out;
+
+static int query_state(const char *format);
+static int query_xstats(const char *action);
+static int query_startup(void);
+static int query_memory(void);
+static int query_xlatency(const char *action);
+static int query_metrics(void);
+static bool out_reserve(size_t n);
+static void put_str(const char *s);
+static void put_uint(uint64_t v);
+static void put_le16(uint16_t v);
+static void put_le32(uint32_t v);
+static void json_client(const Client *c);
+static void bin_client(const Client *c);
+
+/**
+ * @brief Run a query and serialise its result.
+ *
+ * @param args The name of the query followed by its args, NULL terminated.
+ * @param data Set to the serialised reply, which is valid until the next
+ * query.
+ * @param len Set to the length of the reply.
+ *
+ * @return An error code from ipc_errs.
+ */
+int query_run(char **args, const char **data, size_t *len)
+{
+	int err;
+
+	out.len = 0;
+	*data = NULL;
+	*len = 0;
+	if (!*args)
+		return IPC_ERR_TOO_FEW_ARGS;
+
+	if (strcmp("state", *args) == 0)
+		err = query_state(*(args + 1));
+	else if (strcmp("xstats", *args) == 0)
+		err = query_xstats(*(args + 1));
+	else if (strcmp("startup", *args) == 0)
+		err = query_startup();
+	else if (strcmp("memory", *args) == 0)
+		err = query_memory();
+	else if (strcmp("xlatency", *args) == 0)
+		err = query_xlatency(*(args + 1));
+	else if (strcmp("metrics", *args) == 0)
+		err = query_metrics();
+	else
+		return IPC_ERR_NO_FUNC;
+
+	if (err == IPC_ERR_NONE) {
+		*data = out.data;
+		*len = out.len;
+	}
+	return err;
+}
+
+/**
+ * @brief Free the reply buffer.
+ */
+void query_cleanup(void)
+{
+	free(out.data);
+	out.data = NULL;
+	out.len = out.cap = 0;
+}
+
+/**
+ * @brief Make sure that there is room for n more bytes in the reply buffer.
+ *
+ * @param n The amount of bytes that are about to be appended.
+ *
+ * @return False if memory couldn't be allocated.
+ */
+static bool out_reserve(size_t n)
+{
+	size_t cap = out.cap ? out.cap : QUERY_BUF_SIZE;
+	char *new;
+
+	if (out.len + n <= out.cap)
+		return true;
+	while (cap < out.len + n)
+		cap *= 2;
+	new = realloc(out.data, cap);
+	if (!new) {
+		log_err("Can't allocate memory for a query reply.");
+		return false;
+	}
+	out.data = new;
+	out.cap = cap;
+	return true;
+}
+
+static void put_str(const char *s)
+{
+	size_t n = strlen(s);
+
+	memcpy(out.data + out.len, s, n);
+	out.len += n;
+}
+
+static void put_uint(uint64_t v)
+{
+	char tmp[20];
+	int i = 0;
+
+	do {
+		tmp[i++] = '0' + (v % 10);
+		v /= 10;
+	} while (v);
+	while (i > 0)
+		out.data[out.len++] = tmp[--i];
+}
+
+static void put_le16(uint16_t v)
+{
+	out.data[out.len++] = v & 0xFF;
+	out.data[out.len++] = (v >> 8) & 0xFF;
+}
+
+static void put_le32(uint32_t v)
+{
+	put_le16(v & 0xFFFF);
+	put_le16((v >> 16) & 0xFFFF);
+}
+
+/**
+ * @brief Count every client that howm knows about, including those on the
+ * scratchpad and in the delete register.
+ *
+ * @return The amount of clients.
+ */
+static size_t count_all_clients(void)
+{
+	size_t n = 0;
+	unsigned int i;
+	Client *c;
+
+	for (i = 1; i <= WORKSPACES; i++)
+		for (c = wss[i].head; c; c = c->next)
+			n++;
+	for (i = 1; i <= del_reg.size; i++)
+		for (c = del_reg.contents[i]; c; c = c->next)
+			n++;
+	return n + (scratchpad ? 1 : 0);
+}
+
+static void json_client(const Client *c)
+{
+	put_str("{\"win\":");
+	put_uint(c->win);
+	put_str(",\"x\":");
+	put_uint(c->x);
+	put_str(",\"y\":");
+	put_uint(c->y);
+	put_str(",\"w\":");
+	put_uint(c->w);
+	put_str(",\"h\":");
+	put_uint(c->h);
+	put_str(",\"gap\":");
+	put_uint(c->gap);
+	put_str(c->is_floating ? ",\"floating\":true" : ",\"floating\":false");
+	put_str(c->is_fullscreen ? ",\"fullscreen\":true" : ",\"fullscreen\":false");
+	put_str(c->is_transient ? ",\"transient\":true" : ",\"transient\":false");
+	put_str(c->is_urgent ? ",\"urgent\":true}" : ",\"urgent\":false}");
+}
+
+static void json_client_list(const Client *c)
+{
+	put_str("[");
+	for (; c; c = c->next) {
+		json_client(c);
+		if (c->next)
+			put_str(",");
+	}
+	put_str("]");
+}
+
+static void bin_client(const Client *c)
+{
+	put_le32(c->win);
+	put_le16(c->x);
+	put_le16(c->y);
+	put_le16(c->w);
+	put_le16(c->h);
+	put_le16(c->gap);
+	out.data[out.len++] = (c->is_floating ? QUERY_FLOATING : 0)
+		| (c->is_fullscreen ? QUERY_FULLSCREEN : 0)
+		| (c->is_transient ? QUERY_TRANSIENT : 0)
+		| (c->is_urgent ? QUERY_URGENT : 0);
+	out.data[out.len++] = 0;
+}
+
+/**
+ * @brief Serialise a list of clients, preceded by how many there are.
+ *
+ * @param c The head of the list.
+ */
+static void bin_client_list(const Client *c)
+{
+	size_t cnt_pos = out.len;
+	uint16_t n = 0;
+
+	put_le16(0);
+	for (; c; c = c->next, n++)
+		bin_client(c);
+	out.data[cnt_pos] = n & 0xFF;
+	out.data[cnt_pos + 1] = (n >> 8) & 0xFF;
+}
+
+static void json_state(void)
+{
+	char ratio[16];
+	unsigned int w;
+
+	put_str("{\"cur_ws\":");
+	put_uint(cw);
+	put_str(",\"last_ws\":");
+	put_uint(last_ws);
+	put_str(",\"mode\":");
+	put_uint(cur_mode);
+	put_str(",\"state\":");
+	put_uint(cur_state);
+	put_str(",\"screen_width\":");
+	put_uint(screen_width);
+	put_str(",\"screen_height\":");
+	put_uint(screen_height);
+	put_str(",\"workspaces\":[");
+	for (w = 1; w <= WORKSPACES; w++) {
+		snprintf(ratio, sizeof(ratio), "%.3f", wss[w].master_ratio);
+		put_str(w > 1 ? ",{\"layout\":" : "{\"layout\":");
+		put_uint(wss[w].layout);
+		put_str(",\"master_ratio\":");
+		put_str(ratio);
+		put_str(",\"gap\":");
+		put_uint(wss[w].gap);
+		put_str(",\"bar_height\":");
+		put_uint(wss[w].bar_height);
+		put_str(",\"current\":");
+		put_uint(wss[w].current ? wss[w].current->win : 0);
+		put_str(",\"prev_foc\":");
+		put_uint(wss[w].prev_foc ? wss[w].prev_foc->win : 0);
+		put_str(",\"clients\":");
+		json_client_list(wss[w].head);
+		put_str("}");
+	}
+	put_str("],\"scratchpad\":");
+	if (scratchpad)
+		json_client(scratchpad);
+	else
+		put_str("null");
+	put_str(",\"delete_register\":[");
+	for (w = 1; w <= del_reg.size; w++) {
+		if (w > 1)
+			put_str(",");
+		json_client_list(del_reg.contents[w]);
+	}
+	put_str("]}\n");
+}
+
+static void bin_state(void)
+{
+	unsigned int w;
+
+	put_le32(QUERY_MAGIC);
+	put_le16(QUERY_VERSION);
+	put_le16(WORKSPACES);
+	put_le16(cw);
+	put_le16(last_ws);
+	out.data[out.len++] = cur_mode;
+	out.data[out.len++] = cur_state;
+	put_le16(screen_width);
+	put_le16(screen_height);
+	put_le16(del_reg.size);
+	for (w = 1; w <= WORKSPACES; w++) {
+		out.data[out.len++] = wss[w].layout;
+		out.data[out.len++] = 0;
+		put_le16(wss[w].gap);
+		put_le16(wss[w].bar_height);
+		put_le32((uint32_t)(wss[w].master_ratio * 1000 + 0.5));
+		put_le32(wss[w].current ? wss[w].current->win : 0);
+		put_le32(wss[w].prev_foc ? wss[w].prev_foc->win : 0);
+		bin_client_list(wss[w].head);
+	}
+	put_le16(scratchpad ? 1 : 0);
+	if (scratchpad)
+		bin_client(scratchpad);
+	for (w = 1; w <= del_reg.size; w++)
+		bin_client_list(del_reg.contents[w]);
+}
+
+/**
+ * @brief Serialise the entire state of howm.
+ *
+ * @param format Either "json" (the default) or "binary".
+ *
+ * @return An error code from ipc_errs.
+ */
+static int query_state(const char *format)
+{
+	bool json = !format || strcmp("json", format) == 0;
+
+	if (!json && strcmp("binary", format) != 0)
+		return IPC_ERR_SYNTAX;
+	if (!out_reserve(QUERY_FIXED_SIZE + count_all_clients() * QUERY_CLIENT_SIZE))
+		return IPC_ERR_ALLOC;
+
+	if (json)
+		json_state();
+	else
+		bin_state();
+	return IPC_ERR_NONE;
+}
+
+static void json_name(const char *name, const char *prefix, unsigned int n)
+{
+	put_str("\"");
+	if (name) {
+		put_str(name);
+	} else {
+		put_str(prefix);
+		put_uint(n);
+	}
+	put_str("\"");
+}
+
+static void json_xstats_op(unsigned int op, const struct xstats_op *o)
+{
+	const struct xstats_budget *b;
+	unsigned int i;
+	bool first = true;
+
+	put_str("{\"op\":");
+	json_name(xstats_op_name(op), "event_", op - IPC_OP_END);
+	put_str(",\"calls\":");
+	put_uint(o->calls);
+	put_str(",\"requests\":");
+	put_uint(o->requests);
+	put_str(",\"round_trips\":");
+	put_uint(o->round_trips);
+	put_str(",\"max_requests\":");
+	put_uint(o->max_requests);
+	put_str(",\"max_round_trips\":");
+	put_uint(o->max_round_trips);
+	if ((b = xstats_get_budget(op))) {
+		put_str(",\"budget\":{\"fixed\":");
+		put_uint(b->fixed);
+		put_str(",\"per_client\":");
+		put_uint(b->per_client);
+		put_str(",\"round_trips\":");
+		put_uint(b->round_trips);
+		put_str("},\"over_budget\":");
+		put_uint(o->over_budget);
+	}
+	put_str(",\"by_opcode\":{");
+	for (i = 0; i < XSTATS_OPCODES; i++) {
+		if (!o->by_opcode[i])
+			continue;
+		if (!first)
+			put_str(",");
+		first = false;
+		json_name(xstats_opcode_name(i), "opcode_", i);
+		put_str(":");
+		put_uint(o->by_opcode[i]);
+	}
+	put_str("}}");
+}
+
+/**
+ * @brief Serialise the X requests made by each operation that has made any,
+ * or been performed.
+ *
+ * @param action NULL, or "reset" to clear the counts once they have been
+ * serialised.
+ *
+ * @return An error code from ipc_errs.
+ */
+static int query_xstats(const char *action)
+{
+	const struct xstats_op *o;
+	unsigned int op, i;
+	size_t size = 64;
+	bool first = true;
+
+	if (action && strcmp("reset", action) != 0)
+		return IPC_ERR_SYNTAX;
+	for (op = 0; op < XSTATS_OPS; op++) {
+		o = xstats_get(op);
+		if (!o->calls && !o->requests)
+			continue;
+		size += QUERY_XSTATS_OP_SIZE;
+		for (i = 0; i < XSTATS_OPCODES; i++)
+			if (o->by_opcode[i])
+				size += QUERY_XSTATS_OPCODE_SIZE;
+	}
+	if (!out_reserve(size))
+		return IPC_ERR_ALLOC;
+
+	put_str("{\"ops\":[");
+	for (op = 0; op < XSTATS_OPS; op++) {
+		o = xstats_get(op);
+		if (!o->calls && !o->requests)
+			continue;
+		if (!first)
+			put_str(",");
+		first = false;
+		json_xstats_op(op, o);
+	}
+	put_str("]}\n");
+
+	if (action)
+		xstats_reset();
+	return IPC_ERR_NONE;
+}
+
+/**
+ * @brief Serialise when each point in startup was reached.
+ *
+ * Each mark holds its CLOCK_MONOTONIC timestamp and the microseconds since
+ * the previous mark that has been reached, which is how long the phase ending
+ * at the mark took. Marks that haven't been reached are left out.
+ *
+ * @return An error code from ipc_errs.
+ */
+static int query_startup(void)
+{
+	const struct startup *s = startup_get();
+	uint64_t prev = s->ns[STARTUP_MAIN];
+	unsigned int i;
+	bool first = true;
+
+	if (!out_reserve(64 + STARTUP_END * QUERY_STARTUP_MARK_SIZE))
+		return IPC_ERR_ALLOC;
+
+	put_str("{\"config_messages\":");
+	put_uint(s->config_cnt);
+	put_str(",\"marks\":[");
+	for (i = 0; i < STARTUP_END; i++) {
+		if (!s->ns[i])
+			continue;
+		if (!first)
+			put_str(",");
+		first = false;
+		put_str("{\"name\":\"");
+		put_str(startup_mark_name(i));
+		put_str("\",\"ns\":");
+		put_uint(s->ns[i]);
+		put_str(",\"phase_us\":");
+		put_uint(s->ns[i] > prev ? (s->ns[i] - prev) / 1000 : 0);
+		put_str("}");
+		prev = s->ns[i];
+	}
+	put_str("]}\n");
+	return IPC_ERR_NONE;
+}
+
+/**
+ * @brief Serialise how much memory howm is using.
+ *
+ * Allocated clients that can't be reached from a workspace, the scratchpad or
+ * the delete register have leaked. The other figures are fixed after startup,
+ * so any growth in the resident set size that doesn't settle points at a leak
+ * outside of the counted allocations.
+ *
+ * @return An error code from ipc_errs.
+ */
+static int query_memory(void)
+{
+	const struct mem_counter *m;
+	uint64_t rss, peak_rss;
+	unsigned int i;
+
+	if (!out_reserve(QUERY_MEMORY_SIZE))
+		return IPC_ERR_ALLOC;
+
+	put_str("{\"counters\":{");
+	for (i = 0; i < MEM_COUNTERS_END; i++) {
+		m = mem_get(i);
+		if (i > 0)
+			put_str(",");
+		put_str("\"");
+		put_str(mem_counter_name(i));
+		put_str("\":{\"live\":");
+		put_uint(m->live);
+		put_str(",\"peak\":");
+		put_uint(m->peak);
+		put_str(",\"total\":");
+		put_uint(m->total);
+		put_str("}");
+	}
+	put_str("},\"clients_reachable\":");
+	put_uint(count_all_clients());
+	put_str(",\"client_bytes\":");
+	put_uint(mem_get(MEM_CLIENTS)->live * sizeof(Client));
+	put_str(",\"ipc_conns\":{\"open\":");
+	put_uint(ipc_open_conns());
+	put_str(",\"slots\":");
+	put_uint(IPC_MAX_CONNS);
+	put_str(",\"bytes\":");
+	put_uint(IPC_MAX_CONNS * IPC_BUF_SIZE);
+	put_str("},\"delete_register\":{\"used\":");
+	put_uint(del_reg.size);
+	put_str(",\"slots\":");
+	put_uint(conf.delete_register_size);
+	put_str(",\"bytes\":");
+	put_uint((conf.delete_register_size + 1) * sizeof(Client *));
+	put_str("},\"query_buffer_bytes\":");
+	put_uint(out.cap);
+	if (mem_rss(&rss, &peak_rss)) {
+		put_str(",\"rss_kb\":");
+		put_uint(rss);
+		put_str(",\"peak_rss_kb\":");
+		put_uint(peak_rss);
+	}
+	put_str("}\n");
+	return IPC_ERR_NONE;
+}
+
+/**
+ * @brief Serialise the X server's round trip latency.
+ *
+ * @param action NULL, or "reset" to clear the latencies once they have been
+ * serialised.
+ *
+ * @return An error code from ipc_errs.
+ */
+static int query_xlatency(const char *action)
+{
+	const struct xlatency *x = xlatency_get();
+	unsigned int i;
+
+	if (action && strcmp("reset", action) != 0)
+		return IPC_ERR_SYNTAX;
+	if (!out_reserve(QUERY_XLATENCY_SIZE))
+		return IPC_ERR_ALLOC;
+
+	put_str("{\"interval_ms\":");
+	put_uint(conf.xlatency_interval);
+	put_str(",\"samples\":");
+	put_uint(x->samples);
+	put_str(",\"errors\":");
+	put_uint(x->errors);
+	put_str(",\"min_us\":");
+	put_uint(x->min_us);
+	put_str(",\"mean_us\":");
+	put_uint(x->samples ? x->sum_us / x->samples : 0);
+	put_str(",\"max_us\":");
+	put_uint(x->max_us);
+	put_str(",\"sum_us\":");
+	put_uint(x->sum_us);
+	put_str(",\"seq_gap\":{\"last\":");
+	put_uint(x->last_gap);
+	put_str(",\"max\":");
+	put_uint(x->max_gap);
+	put_str("},\"histogram\":[");
+	for (i = 0; i < XLATENCY_BUCKETS; i++) {
+		if (i > 0)
+			put_str(",");
+		put_str("{\"le_us\":");
+		if (xlatency_bucket_bound(i))
+			put_uint(xlatency_bucket_bound(i));
+		else
+			put_str("null");
+		put_str(",\"count\":");
+		put_uint(x->buckets[i]);
+		put_str("}");
+	}
+	put_str("]}\n");
+
+	if (action)
+		xlatency_reset();
+	return IPC_ERR_NONE;
+}
+
+/**
+ * @brief Serialise howm's metrics, in the Prometheus text format.
+ *
+ * @return An error code from ipc_errs.
+ */
+static int query_metrics(void)
+{
+	const char *m;
+	size_t len;
+
+	m = metrics_render(&len);
+	if (!out_reserve(len + 1))
+		return IPC_ERR_ALLOC;
+	memcpy(out.data + out.len, m, len);
+	out.len += len;
+	return IPC_ERR_NONE;
+}
@@ -0,0 +1,64 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stddef.h>
+
+/**
+ * @file query.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/** Identifies a binary state dump ("HWMQ" in ASCII). */
+#define QUERY_MAGIC 0x514d5748
+/** Bumped whenever the layout of the binary state dump changes. */
+#define QUERY_VERSION 1
+
+/* A binary state dump is a sequence of little endian records:
+ *
+ * Header (20 bytes):
+ *   uint32_t magic (QUERY_MAGIC)
+ *   uint16_t version (QUERY_VERSION)
+ *   uint16_t amount of workspaces
+ *   uint16_t current workspace
+ *   uint16_t last workspace
+ *   uint8_t  mode
+ *   uint8_t  operator state
+ *   uint16_t screen width
+ *   uint16_t screen height
+ *   uint16_t amount of delete register entries
+ *
+ * Then, for each workspace (20 bytes), followed by its clients:
+ *   uint8_t  layout
+ *   uint8_t  reserved
+ *   uint16_t gap
+ *   uint16_t bar height
+ *   uint32_t master ratio, multiplied by 1000
+ *   uint32_t current window, or 0
+ *   uint32_t previously focused window, or 0
+ *   uint16_t amount of client records that follow
+ *
+ * A client (16 bytes):
+ *   uint32_t window
+ *   uint16_t x, y, w, h, gap
+ *   uint8_t  flags (QUERY_FLOATING etc.)
+ *   uint8_t  reserved
+ *
+ * Then a uint16_t holding 1 if the scratchpad is in use, followed by that
+ * client.
+ *
+ * Then, for each delete register entry (bottom first), a uint16_t amount of
+ * clients followed by their client records.
+ */
+
+enum query_client_flags { QUERY_FLOATING = 1, QUERY_FULLSCREEN = 2,
+	QUERY_TRANSIENT = 4, QUERY_URGENT = 8 };
+
+int query_run(char **args, const char **data, size_t *len);
+void query_cleanup(void);
+
+#endif
@@ -0,0 +1,126 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <xcb/xcb.h>
+
+#include "scheduler.h"
+#include "howm.h"
+#include "helper.h"
+#include "handler.h"
+#include "ipc.h"
+#include "xlatency.h"
+
+/**
+ * @file scheduler.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Share the main loop fairly between X events and IPC messages.
+ *
+ * Each round runs at most conf.sched_quantum interactive IPC messages, then
+ * at most as many X events, then a quarter as many bulk IPC messages. Work
+ * that is left over waits for the next round, which starts without sleeping.
+ * A script flooding the socket with commands, or a client flooding the X
+ * server with events, can then only slow the other source down by one
+ * quantum, and keybindings are always run before bulk work.
+ */
+
+static struct sched stats;
+static bool x_backlog;
+
+static const char *source_names[SCHED_SOURCES_END] = {
+	[SCHED_INTERACTIVE] = "interactive",
+	[SCHED_X] = "x",
+	[SCHED_BULK] = "bulk",
+};
+
+/**
+ * @brief Handle X events that have arrived.
+ *
+ * @param ready Can the X connection be read from? If not, only events that
+ * XCB has already read (such as whilst waiting for a reply) are handled.
+ * @param quantum The most events to handle.
+ *
+ * @return The amount of events that were handled.
+ */
+static unsigned int sched_x(bool ready, unsigned int quantum)
+{
+	xcb_generic_event_t *ev;
+	unsigned int n = 0;
+
+	while (n < quantum && (ev = ready ? xcb_poll_for_event(dpy)
+				: xcb_poll_for_queued_event(dpy)) != NULL) {
+		xlatency_seen(ev->full_sequence);
+		handle_event(ev);
+		free(ev);
+		n++;
+	}
+	return n;
+}
+
+/**
+ * @brief Run one round of work from each source.
+ *
+ * @param x_ready Has select marked the X connection as readable?
+ *
+ * @return True if work is still waiting, in which case the main loop
+ * shouldn't sleep.
+ */
+bool sched_run(bool x_ready)
+{
+	unsigned int quantum = conf.sched_quantum ? conf.sched_quantum : 1;
+	unsigned int done[SCHED_SOURCES_END];
+	unsigned int i, depth;
+	bool backlog = false;
+
+	for (i = IPC_CLASS_INTERACTIVE; i < IPC_CLASS_END; i++) {
+		depth = ipc_queue_depth(i);
+		if (depth > stats.max_depth[i])
+			stats.max_depth[i] = depth;
+	}
+
+	done[SCHED_INTERACTIVE] = ipc_run(IPC_CLASS_INTERACTIVE, quantum);
+	done[SCHED_X] = sched_x(x_ready || x_backlog, quantum);
+	x_backlog = done[SCHED_X] == quantum;
+	done[SCHED_BULK] = ipc_run(IPC_CLASS_BULK, (quantum + 3) / 4);
+
+	for (i = 0; i < SCHED_SOURCES_END; i++)
+		stats.done[i] += done[i];
+	if (done[SCHED_INTERACTIVE] || done[SCHED_X] || done[SCHED_BULK])
+		stats.rounds++;
+
+	if (ipc_queue_depth(IPC_CLASS_INTERACTIVE)) {
+		stats.backlog[SCHED_INTERACTIVE]++;
+		backlog = true;
+	}
+	if (x_backlog) {
+		stats.backlog[SCHED_X]++;
+		backlog = true;
+	}
+	if (ipc_queue_depth(IPC_CLASS_BULK)) {
+		stats.backlog[SCHED_BULK]++;
+		backlog = true;
+	}
+	return backlog;
+}
+
+/**
+ * @brief Get how much work the scheduler has done.
+ */
+const struct sched *sched_get(void)
+{
+	return &stats;
+}
+
+/**
+ * @brief Get the name of a source of work.
+ *
+ * @param source The source, from sched_sources.
+ *
+ * @return The name, or NULL if there is no such source.
+ */
+const char *sched_source_name(unsigned int source)
+{
+	return source < SCHED_SOURCES_END ? source_names[source] : NULL;
+}
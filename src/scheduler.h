@@ -0,0 +1,38 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ipc.h"
+
+/**
+ * @file scheduler.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/** The sources of work that the scheduler takes turns between. */
+enum sched_sources { SCHED_INTERACTIVE, SCHED_X, SCHED_BULK, SCHED_SOURCES_END };
+
+/**
+ * @brief How much work the scheduler has done.
+ */
+struct sched {
+	uint64_t rounds; /**< Rounds that ran any work. */
+	uint64_t done[SCHED_SOURCES_END]; /**< Messages or events run. */
+	uint64_t backlog[SCHED_SOURCES_END]; /**< Rounds that ended with work
+			still waiting from that source. */
+	uint32_t max_depth[IPC_CLASS_END]; /**< The most IPC messages of each
+			class that have been waiting at once. */
+};
+
+bool sched_run(bool x_ready);
+const struct sched *sched_get(void);
+const char *sched_source_name(unsigned int source);
+
+#endif
@@ -4,6 +4,7 @@
 #include "helper.h"
 #include "workspace.h"
 #include "howm.h"
+#include "xstats.h"
 
 /**
  * @file scratchpad.c
@@ -17,19 +18,20 @@
  */
 
 struct stack del_reg;
-static Client *scratchpad;
+Client *scratchpad;
 
 /**
  * @brief Dynamically allocate space for the contents of the stack.
  *
  * We don't know how big the stack will be when the struct is defined, so we
- * need to allocate it dynamically.
+ * need to allocate it dynamically. The stack is indexed from 1, so there is
+ * one more slot than it can hold.
  *
  * @param s The stack that needs to have its contents allocated.
  */
 void stack_init(struct stack *s)
 {
-	s->contents = (Client **)malloc(sizeof(Client) * conf.delete_register_size);
+	s->contents = (Client **)malloc(sizeof(Client *) * (conf.delete_register_size + 1));
 	if (!s->contents)
 		log_err("Failed to allocate memory for stack.");
 }
@@ -35,6 +35,7 @@ struct stack {
 };
 
 extern struct stack del_reg;
+extern Client *scratchpad;
 
 void stack_push(struct stack *s, Client *c);
 Client *stack_pop(struct stack *s);
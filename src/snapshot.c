@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+#include "howm.h"
+#include "helper.h"
+
+/**
+ * @file snapshot.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Publish howm's state in shared memory, so that status bars can read
+ * it without a round trip over IPC or having to parse text.
+ *
+ * The snapshot lives in a memfd that is protected by a seqlock. Readers are
+ * given a read only descriptor for it and their own eventfd, which is
+ * signalled whenever the snapshot changes.
+ */
+
+_Static_assert(WORKSPACES <= SNAPSHOT_MAX_WS, "WORKSPACES is too large for a snapshot");
+
+static int shm_fd = -1;
+/* A read only descriptor for the memfd, which is what readers are sent. */
+static int ro_fd = -1;
+static struct howm_snapshot *shm;
+static struct howm_snapshot last;
+static int readers[SNAPSHOT_MAX_READERS];
+static unsigned int next_reader;
+
+/**
+ * @brief Create the memfd that holds the snapshot and map it.
+ *
+ * Failure isn't fatal: howm carries on without publishing a snapshot.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int snapshot_init(void)
+{
+	char path[32];
+	unsigned int i;
+
+	for (i = 0; i < LENGTH(readers); i++)
+		readers[i] = -1;
+
+	shm_fd = memfd_create("howm-snapshot", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (shm_fd == -1) {
+		log_err("Couldn't create the snapshot memfd. errno: %d", errno);
+		return -1;
+	}
+	if (ftruncate(shm_fd, sizeof(struct howm_snapshot)) == -1) {
+		log_err("Couldn't size the snapshot memfd. errno: %d", errno);
+		goto fail;
+	}
+	/* Readers can't change the size of the mapping from under us. */
+	if (fcntl(shm_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) == -1) {
+		log_err("Couldn't seal the snapshot memfd. errno: %d", errno);
+		goto fail;
+	}
+	/* Reopening the memfd through /proc gives a descriptor that can't be
+	 * used to write to the snapshot or to map it writable. */
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", shm_fd);
+	ro_fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (ro_fd == -1) {
+		log_err("Couldn't open a read only snapshot memfd. errno: %d", errno);
+		goto fail;
+	}
+	shm = mmap(NULL, sizeof(struct howm_snapshot), PROT_READ | PROT_WRITE,
+			MAP_SHARED, shm_fd, 0);
+	if (shm == MAP_FAILED) {
+		log_err("Couldn't map the snapshot memfd. errno: %d", errno);
+		shm = NULL;
+		goto fail;
+	}
+#ifdef F_SEAL_FUTURE_WRITE
+	/* Stop a reader from reopening its descriptor for writing, whilst
+	 * leaving our own mapping writable. */
+	if (fcntl(shm_fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE) == -1)
+		log_warn("Couldn't seal the snapshot memfd against writes. errno: %d", errno);
+#endif
+	shm->magic = SNAPSHOT_MAGIC;
+	shm->version = SNAPSHOT_VERSION;
+	shm->workspaces = WORKSPACES;
+	return 0;
+
+fail:
+	if (ro_fd != -1)
+		close(ro_fd);
+	ro_fd = -1;
+	close(shm_fd);
+	shm_fd = -1;
+	return -1;
+}
+
+/**
+ * @brief Gather the current state of howm.
+ *
+ * @param s Where the state is stored. seq is left untouched.
+ */
+static void snapshot_gather(struct howm_snapshot *s)
+{
+	unsigned int w;
+	Client *c;
+
+	s->magic = SNAPSHOT_MAGIC;
+	s->version = SNAPSHOT_VERSION;
+	s->workspaces = WORKSPACES;
+	s->cur_ws = cw;
+	s->mode = cur_mode;
+	s->state = cur_state;
+	s->focused_win = wss[cw].current ? wss[cw].current->win : 0;
+	s->urgent_cnt = 0;
+	for (w = 1; w <= WORKSPACES; w++) {
+		s->ws[w - 1].layout = wss[w].layout;
+		s->ws[w - 1].client_cnt = wss[w].client_cnt;
+		s->ws[w - 1].focused_win = wss[w].current ? wss[w].current->win : 0;
+		s->ws[w - 1].urgent_cnt = 0;
+		for (c = wss[w].head; c; c = c->next)
+			if (c->is_urgent)
+				s->ws[w - 1].urgent_cnt++;
+		s->urgent_cnt += s->ws[w - 1].urgent_cnt;
+	}
+}
+
+/**
+ * @brief Publish the current state if it differs from the last snapshot and
+ * wake up any readers.
+ *
+ * This is called once per iteration of the main loop, so a command that
+ * changes the state several times only causes one update.
+ */
+void snapshot_update(void)
+{
+	struct howm_snapshot cur;
+	uint64_t one = 1;
+	uint32_t seq;
+	unsigned int i;
+
+	if (!shm)
+		return;
+
+	memset(&cur, 0, sizeof(cur));
+	snapshot_gather(&cur);
+	cur.seq = last.seq;
+	if (memcmp(&cur, &last, sizeof(cur)) == 0)
+		return;
+
+	seq = last.seq;
+	__atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(&shm->workspaces, &cur.workspaces,
+			sizeof(cur) - offsetof(struct howm_snapshot, workspaces));
+	__atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+
+	last = cur;
+	last.seq = seq + 2;
+
+	for (i = 0; i < LENGTH(readers); i++)
+		if (readers[i] != -1 && write(readers[i], &one, sizeof(one)) == -1
+				&& errno != EAGAIN)
+			log_warn("Couldn't notify snapshot reader %u. errno: %d", i, errno);
+}
+
+/**
+ * @brief Register a new reader of the snapshot.
+ *
+ * howm can't tell when a reader has gone away, so rather than refusing new
+ * readers once there are SNAPSHOT_MAX_READERS of them (and never publishing
+ * to a status bar that has been restarted that many times), the oldest reader
+ * stops being notified of changes. It can still read the snapshot, but has to
+ * send MSG_SNAPSHOT again to get a new eventfd.
+ *
+ * @param fds Filled with a read only descriptor for the memfd and a new
+ * eventfd for this reader.
+ *
+ * @return The amount of file descriptors stored in fds, 0 if snapshots aren't
+ * available.
+ */
+int snapshot_add_reader(int *fds)
+{
+	int efd;
+
+	if (!shm)
+		return 0;
+	efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (efd == -1) {
+		log_err("Couldn't create an eventfd for a snapshot reader. errno: %d", errno);
+		return 0;
+	}
+	if (readers[next_reader] != -1) {
+		log_info("Snapshot reader %u is no longer notified of changes", next_reader);
+		close(readers[next_reader]);
+	}
+	readers[next_reader] = efd;
+	next_reader = (next_reader + 1) % LENGTH(readers);
+
+	fds[0] = ro_fd;
+	fds[1] = efd;
+	return 2;
+}
+
+/**
+ * @brief Unmap the snapshot and close all file descriptors.
+ */
+void snapshot_cleanup(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < LENGTH(readers); i++) {
+		if (readers[i] != -1)
+			close(readers[i]);
+		readers[i] = -1;
+	}
+	if (shm)
+		munmap(shm, sizeof(struct howm_snapshot));
+	shm = NULL;
+	if (ro_fd != -1)
+		close(ro_fd);
+	ro_fd = -1;
+	if (shm_fd != -1)
+		close(shm_fd);
+	shm_fd = -1;
+}
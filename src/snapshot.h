@@ -0,0 +1,79 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+/**
+ * @file snapshot.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/** Identifies a mapping as a howm snapshot ("howm" in ASCII). */
+#define SNAPSHOT_MAGIC 0x686f776d
+/** Bumped whenever the layout of struct howm_snapshot changes. */
+#define SNAPSHOT_VERSION 1
+/** The most workspaces that a snapshot can describe. */
+#define SNAPSHOT_MAX_WS 32
+/** The most readers that can be notified of changes at once. */
+#define SNAPSHOT_MAX_READERS 8
+
+/**
+ * @brief The state of a single workspace, as seen by a status bar.
+ */
+struct howm_ws_snapshot {
+	uint32_t layout; /**< The layout, as defined in the layout enum. */
+	uint32_t client_cnt; /**< The amount of clients on this workspace. */
+	uint32_t urgent_cnt; /**< How many of those clients are urgent. */
+	uint32_t focused_win; /**< The current client's window, or 0. */
+};
+
+/**
+ * @brief The state of howm that is published in shared memory.
+ *
+ * howm is the only writer. seq is odd whilst the struct is being written and
+ * is incremented again once it is consistent, so a reader must retry if seq
+ * was odd or changed whilst it was copying. howm_snapshot_read() does this.
+ */
+struct howm_snapshot {
+	uint32_t magic; /**< Always SNAPSHOT_MAGIC. */
+	uint32_t version; /**< Always SNAPSHOT_VERSION. */
+	uint32_t seq; /**< The seqlock sequence counter. */
+	uint32_t workspaces; /**< The amount of valid entries in ws. */
+	uint32_t cur_ws; /**< The current workspace, starting from 1. */
+	uint32_t mode; /**< The current mode, as defined in the modes enum. */
+	uint32_t state; /**< The state of the operator state machine. */
+	uint32_t focused_win; /**< The focused window, or 0. */
+	uint32_t urgent_cnt; /**< The amount of urgent clients on all workspaces. */
+	struct howm_ws_snapshot ws[SNAPSHOT_MAX_WS]; /**< ws[0] is workspace 1. */
+};
+
+/**
+ * @brief Take a consistent copy of a snapshot that is being updated by howm.
+ *
+ * @param shm The snapshot mapped from the memfd that howm sent.
+ * @param out Where the copy is stored.
+ */
+static inline void howm_snapshot_read(const struct howm_snapshot *shm,
+		struct howm_snapshot *out)
+{
+	uint32_t s1, s2;
+
+	do {
+		s1 = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+		*out = *shm;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s2 = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+	} while ((s1 & 1) || s1 != s2);
+}
+
+int snapshot_init(void);
+void snapshot_update(void);
+int snapshot_add_reader(int *fds);
+void snapshot_cleanup(void);
+
+#endif
@@ -0,0 +1,78 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+
+#include "startup.h"
+
+/**
+ * @file startup.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Record how long each phase of howm's startup takes.
+ *
+ * Timestamps are taken from CLOCK_MONOTONIC, so that they can be compared with
+ * those of another process on the same machine, such as a benchmark that
+ * started howm.
+ */
+
+static struct startup startup;
+
+static const char *mark_names[STARTUP_END] = {
+	[STARTUP_MAIN] = "main",
+	[STARTUP_CONNECT] = "xcb_connect",
+	[STARTUP_ATOMS] = "atoms",
+	[STARTUP_EWMH] = "ewmh",
+	[STARTUP_COLOURS] = "colours",
+	[STARTUP_SETUP] = "setup",
+	[STARTUP_IPC_INIT] = "ipc_init",
+	[STARTUP_CHECK_WM] = "check_other_wm",
+	[STARTUP_EXEC_CONFIG] = "exec_config",
+	[STARTUP_FIRST_EVENT] = "first_event",
+	[STARTUP_FIRST_CONFIG] = "first_config",
+	[STARTUP_LAST_CONFIG] = "last_config",
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Record that a point in startup has been reached, unless it already
+ * has been.
+ *
+ * @param mark The point, from startup_marks.
+ */
+void startup_mark(unsigned int mark)
+{
+	if (mark < STARTUP_END && !startup.ns[mark])
+		startup.ns[mark] = now_ns();
+}
+
+/**
+ * @brief Record that a config message has been processed.
+ *
+ * Applying the config file has no clear end, as it is a script that sends any
+ * amount of messages, so the first and the most recent messages are recorded.
+ */
+void startup_config(void)
+{
+	startup_mark(STARTUP_FIRST_CONFIG);
+	startup.ns[STARTUP_LAST_CONFIG] = now_ns();
+	startup.config_cnt++;
+}
+
+const struct startup *startup_get(void)
+{
+	return &startup;
+}
+
+const char *startup_mark_name(unsigned int mark)
+{
+	return mark < STARTUP_END ? mark_names[mark] : NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <stdint.h>
+
+/**
+ * @file startup.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/** The points during startup that are timed. Each one marks the end of a
+ * phase, which starts at the previous mark. */
+enum startup_marks { STARTUP_MAIN, STARTUP_CONNECT, STARTUP_ATOMS,
+	STARTUP_EWMH, STARTUP_COLOURS, STARTUP_SETUP, STARTUP_IPC_INIT,
+	STARTUP_CHECK_WM, STARTUP_EXEC_CONFIG, STARTUP_FIRST_EVENT,
+	STARTUP_FIRST_CONFIG, STARTUP_LAST_CONFIG, STARTUP_END };
+
+/**
+ * @brief When each startup mark was reached.
+ */
+struct startup {
+	uint64_t ns[STARTUP_END]; /**< CLOCK_MONOTONIC, or 0 if not yet reached. */
+	uint32_t config_cnt; /**< The amount of MSG_CONFIG messages processed. */
+};
+
+void startup_mark(unsigned int mark);
+void startup_config(void);
+const struct startup *startup_get(void);
+const char *startup_mark_name(unsigned int mark);
+
+#endif
@@ -0,0 +1,235 @@
+#define _POSIX_C_SOURCE 200809L
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "status.h"
+#include "howm.h"
+#include "helper.h"
+
+/**
+ * @file status.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Output howm's state on stdout, for scripts that pipe it into a
+ * status bar.
+ *
+ * The state is rendered into a reusable buffer using conf.status_format and is
+ * only written when it differs from what was last written. conf.status_interval
+ * limits how often lines are written. Writes never block: if stdout is a full
+ * pipe, the rest of the line is written once the pipe can accept it. The pipe
+ * is reopened rather than made non-blocking, as stdout is shared with every
+ * program that howm starts.
+ */
+
+/** The most that can be written for a single update. */
+#define STATUS_BUF_SIZE 1024
+
+static char buf[STATUS_BUF_SIZE];
+static size_t buf_len;
+static char last[STATUS_BUF_SIZE];
+static size_t last_len;
+static size_t sent;
+static bool pending;
+static struct timespec last_emit;
+/* Where lines are written: stdout, or a non-blocking descriptor of its own
+ * for the pipe that stdout refers to. */
+static int out_fd = STDOUT_FILENO;
+
+static void status_render(void);
+static void status_flush(void);
+static long ms_since_emit(void);
+
+/**
+ * @brief Prepare stdout for status output.
+ *
+ * If stdout is a pipe, it is opened again through /proc to get a
+ * non-blocking descriptor, so that a bar that stops reading can't stall howm.
+ * Setting O_NONBLOCK on stdout itself would also affect the programs that
+ * howm starts, which inherit it. Other types of stdout are used as they are.
+ */
+void status_init(void)
+{
+	struct stat st;
+	int fd;
+
+	if (fstat(STDOUT_FILENO, &st) == -1 || !S_ISFIFO(st.st_mode))
+		return;
+	fd = open("/proc/self/fd/1", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd == -1)
+		log_warn("Can't reopen stdout, status output may block. errno: %d", errno);
+	else
+		out_fd = fd;
+}
+
+/**
+ * @brief Append a workspace's state to buf, following conf.status_format.
+ *
+ * @param w The workspace to render.
+ */
+static void status_render_ws(unsigned int w)
+{
+	const char *f;
+	char num[12];
+	int n;
+
+	for (f = conf.status_format; *f && buf_len < STATUS_BUF_SIZE - 1; f++) {
+		if (*f != '%' || !*(f + 1)) {
+			buf[buf_len++] = *f;
+			continue;
+		}
+		switch (*++f) {
+		case 'm':
+			n = snprintf(num, sizeof(num), "%u", cur_mode);
+			break;
+		case 'l':
+			n = snprintf(num, sizeof(num), "%d", wss[w].layout);
+			break;
+		case 'w':
+			n = snprintf(num, sizeof(num), "%u", w);
+			break;
+		case 's':
+			n = snprintf(num, sizeof(num), "%d", cur_state);
+			break;
+		case 'c':
+			n = snprintf(num, sizeof(num), "%d", wss[w].client_cnt);
+			break;
+		default:
+			num[0] = *f;
+			n = 1;
+			break;
+		}
+		if (buf_len + n >= STATUS_BUF_SIZE - 1)
+			break;
+		memcpy(buf + buf_len, num, n);
+		buf_len += n;
+	}
+	buf[buf_len++] = '\n';
+}
+
+/**
+ * @brief Render the current state into buf.
+ *
+ * When debugging is enabled, a line is rendered for every workspace.
+ */
+static void status_render(void)
+{
+	unsigned int w = 0;
+
+	buf_len = 0;
+#if DEBUG_ENABLE
+	for (w = 1; w <= WORKSPACES; w++)
+		status_render_ws(w);
+#else
+	UNUSED(w);
+	status_render_ws(cw);
+#endif
+}
+
+/**
+ * @brief Output the current state, if it has changed since it was last
+ * output.
+ *
+ * This is called once per iteration of the main loop.
+ */
+void status_update(void)
+{
+	if (sent < last_len) {
+		status_flush();
+		if (sent < last_len)
+			return;
+	}
+
+	status_render();
+	if (buf_len == last_len && memcmp(buf, last, buf_len) == 0) {
+		pending = false;
+		return;
+	}
+	if (conf.status_interval && ms_since_emit() < (long)conf.status_interval) {
+		pending = true;
+		return;
+	}
+
+	memcpy(last, buf, buf_len);
+	last_len = buf_len;
+	sent = 0;
+	pending = false;
+	clock_gettime(CLOCK_MONOTONIC, &last_emit);
+	status_flush();
+}
+
+/**
+ * @brief Write as much of the last rendered line as stdout will take.
+ *
+ * If stdout couldn't be reopened, it is only written to when it can accept
+ * more data.
+ */
+static void status_flush(void)
+{
+	struct pollfd pfd = { .fd = out_fd, .events = POLLOUT };
+	ssize_t n;
+
+	if (out_fd == STDOUT_FILENO && poll(&pfd, 1, 0) == 0)
+		return;
+	n = write(out_fd, last + sent, last_len - sent);
+
+	if (n > 0)
+		sent += n;
+	else if (n == -1 && errno != EAGAIN && errno != EINTR)
+		sent = last_len;
+}
+
+/**
+ * @brief Add stdout to a set of file descriptors if there is output waiting
+ * to be written.
+ *
+ * @param descs The write set that will be passed to select.
+ * @param max_fd The current value of the highest fd plus one.
+ *
+ * @return The new value of the highest fd plus one.
+ */
+int status_set_fds(fd_set *descs, int max_fd)
+{
+	if (sent >= last_len)
+		return max_fd;
+	FD_SET(out_fd, descs);
+	return MAX_FD(out_fd, max_fd - 1);
+}
+
+/**
+ * @brief How long the main loop may sleep before a delayed update is due.
+ *
+ * @param tv Storage for the timeout.
+ *
+ * @return tv, or NULL if there isn't a delayed update.
+ */
+struct timeval *status_timeout(struct timeval *tv)
+{
+	long ms;
+
+	if (!pending)
+		return NULL;
+	ms = (long)conf.status_interval - ms_since_emit();
+	if (ms < 0)
+		ms = 0;
+	tv->tv_sec = ms / 1000;
+	tv->tv_usec = (ms % 1000) * 1000;
+	return tv;
+}
+
+static long ms_since_emit(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec - last_emit.tv_sec) * 1000
+		+ (ts.tv_nsec - last_emit.tv_nsec) / 1000000;
+}
@@ -0,0 +1,23 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdbool.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+/**
+ * @file status.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+void status_init(void);
+void status_update(void);
+int status_set_fds(fd_set *descs, int max_fd);
+struct timeval *status_timeout(struct timeval *tv);
+
+#endif
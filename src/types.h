@@ -15,6 +15,16 @@
  * @brief howm
  */
 
+/**
+ * @brief The WM_PROTOCOLS that a client can take part in.
+ */
+enum wm_protocols {
+	WM_PROTO_DELETE_WINDOW = 1 << 0,
+	WM_PROTO_TAKE_FOCUS = 1 << 1,
+	WM_PROTO_PING = 1 << 2,
+	WM_PROTO_SYNC_REQUEST = 1 << 3
+};
+
 /**
  * @brief Represents a client that is being handled by howm.
  *
@@ -28,6 +38,8 @@ typedef struct Client {
 	bool is_transient; /**< Is the client transient?
 					* Defined at: http://standards.freedesktop.org/wm-spec/wm-spec-latest.html*/
 	bool is_urgent; /**< This is set by a client that wants focus for some reason. */
+	uint8_t protocols; /**< The WM_PROTOCOLS that the client supports, from
+			wm_protocols. Refreshed whenever the property changes. */
 	xcb_window_t win; /**< The window that this client represents. */
 	uint16_t x; /**< The x coordinate of the client. */
 	uint16_t y; /**< The y coordinate of the client. */
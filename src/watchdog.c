@@ -0,0 +1,180 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <execinfo.h>
+#endif
+
+#include "watchdog.h"
+#include "howm.h"
+#include "helper.h"
+#include "xstats.h"
+
+/**
+ * @file watchdog.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Notice when the main loop stalls, and leave evidence of where.
+ *
+ * The main loop marks itself busy when select() returns and idle when it is
+ * about to call select() again, so waiting for events never counts as a stall.
+ * A separate thread checks how long the main loop has been busy for. Once that
+ * exceeds conf.watchdog_ms, it signals the main thread, which writes the
+ * operation that it is performing and a backtrace to stderr.
+ *
+ * Logging normally goes through a ring buffer that the main loop flushes, which
+ * won't happen until the stall ends (if it ever does), so the report is written
+ * straight to stderr instead.
+ */
+
+/** The signal used to ask the main thread for a backtrace. */
+#define WATCHDOG_SIGNAL SIGUSR1
+/** How long the watchdog sleeps for when it is disabled. */
+#define WATCHDOG_IDLE_MS 1000
+
+static pthread_t main_thread;
+static pthread_t thread;
+static bool started;
+static uint64_t busy_since; /**< When the main loop went busy, or 0. */
+static bool reported; /**< Has the current stall been reported? */
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void sleep_ms(unsigned int ms)
+{
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+
+	nanosleep(&ts, NULL);
+}
+
+static void write_str(const char *s)
+{
+	if (write(STDERR_FILENO, s, strlen(s)) == -1)
+		return;
+}
+
+/**
+ * @brief Runs on the main thread when it has stalled, so that it can report
+ * what it is doing.
+ *
+ * Only async-signal-safe functions may be used here. backtrace() is called
+ * once by watchdog_init(), so that it has already loaded everything that it
+ * needs.
+ */
+static void watchdog_handler(int sig)
+{
+	const char *op = xstats_op_name(xstats_current());
+#ifdef __GLIBC__
+	void *frames[WATCHDOG_FRAMES];
+	int n;
+#endif
+
+	UNUSED(sig);
+	write_str("[WARN] watchdog: the main loop is stuck in ");
+	write_str(op ? op : "an unnamed event");
+	write_str("\n");
+#ifdef __GLIBC__
+	n = backtrace(frames, WATCHDOG_FRAMES);
+	backtrace_symbols_fd(frames, n, STDERR_FILENO);
+#endif
+}
+
+static void *watchdog_run(void *arg)
+{
+	unsigned int budget;
+	uint64_t since;
+	char msg[128];
+	int len;
+
+	UNUSED(arg);
+	for (;;) {
+		budget = __atomic_load_n(&conf.watchdog_ms, __ATOMIC_RELAXED);
+		sleep_ms(budget ? (budget + 1) / 2 : WATCHDOG_IDLE_MS);
+		since = __atomic_load_n(&busy_since, __ATOMIC_ACQUIRE);
+		if (!budget || !since || now_ms() - since <= budget
+				|| __atomic_exchange_n(&reported, true, __ATOMIC_ACQ_REL))
+			continue;
+		len = snprintf(msg, sizeof(msg),
+				"[WARN] watchdog: the main loop has been busy for %lu ms, its budget is %u ms\n",
+				(unsigned long)(now_ms() - since), budget);
+		if (len > 0 && write(STDERR_FILENO, msg, len) == -1)
+			continue;
+		pthread_kill(main_thread, WATCHDOG_SIGNAL);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Start the watchdog thread.
+ */
+void watchdog_init(void)
+{
+	struct sigaction sa;
+#ifdef __GLIBC__
+	void *frame;
+
+	backtrace(&frame, 1);
+#endif
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = watchdog_handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(WATCHDOG_SIGNAL, &sa, NULL);
+
+	main_thread = pthread_self();
+	if (pthread_create(&thread, NULL, watchdog_run, NULL) != 0) {
+		log_err("Can't start the watchdog thread");
+		return;
+	}
+	started = true;
+}
+
+/**
+ * @brief Mark the main loop as busy handling events.
+ */
+void watchdog_busy(void)
+{
+	__atomic_store_n(&reported, false, __ATOMIC_RELAXED);
+	__atomic_store_n(&busy_since, now_ms(), __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Mark the main loop as waiting for events, logging how long the last
+ * stall lasted if there was one.
+ */
+void watchdog_idle(void)
+{
+	uint64_t since = __atomic_exchange_n(&busy_since, 0, __ATOMIC_ACQ_REL);
+
+	if (since && __atomic_load_n(&reported, __ATOMIC_ACQUIRE))
+		log_warn("The main loop stalled for %lu ms",
+				(unsigned long)(now_ms() - since));
+}
+
+/**
+ * @brief Stop the watchdog thread. It spends nearly all of its time sleeping,
+ * which is a cancellation point, so it stops straight away.
+ */
+void watchdog_cleanup(void)
+{
+	if (!started)
+		return;
+	pthread_cancel(thread);
+	pthread_join(thread, NULL);
+	started = false;
+}
@@ -0,0 +1,22 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+/**
+ * @file watchdog.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/** The most stack frames that are written when the main loop stalls. */
+#define WATCHDOG_FRAMES 32
+
+void watchdog_init(void);
+void watchdog_busy(void);
+void watchdog_idle(void);
+void watchdog_cleanup(void);
+
+#endif
@@ -2,6 +2,8 @@
 #include "workspace.h"
 #include "howm.h"
 #include "helper.h"
+#include "xstats.h"
+#include "probes.h"
 
 /**
  * @file workspace.c
@@ -93,6 +95,7 @@ void change_ws(const int ws)
 
 	if ((unsigned int)ws > WORKSPACES || ws <= 0 || ws == cw)
 		return;
+	PROBE3(change_ws_start, cw, ws, wss[ws].client_cnt);
 	last_ws = cw;
 	log_info("Changing from workspace <%d> to <%d>.", last_ws, ws);
 	for (; c; c = c->next)
@@ -106,6 +109,5 @@ void change_ws(const int ws)
 	xcb_ewmh_geometry_t workarea[] = { { 0, conf.bar_bottom ? 0 : wss[cw].bar_height,
 				screen_width, screen_height - wss[cw].bar_height } };
 	xcb_ewmh_set_workarea(ewmh, 0, LENGTH(workarea), workarea);
-
-	howm_info();
+	PROBE3(change_ws_done, last_ws, cw, wss[cw].client_cnt);
 }
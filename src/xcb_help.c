@@ -7,6 +7,7 @@
 #include "op.h"
 #include "howm.h"
 #include "helper.h"
+#include "xstats.h"
 
 /**
  * @file xcb_help.c
@@ -106,18 +107,19 @@ void elevate_window(xcb_window_t win)
  *
  * @param names The names of the atoms to be fetched.
  * @param atoms Where the returned atoms will be stored.
+ * @param cnt The amount of atoms in names.
  */
-void get_atoms(const char **names, xcb_atom_t *atoms)
+void get_atoms(const char **names, xcb_atom_t *atoms, unsigned int cnt)
 {
 	xcb_intern_atom_reply_t *reply;
 	unsigned int i = 0;
-	xcb_intern_atom_cookie_t cookies[LENGTH(*names)];
+	xcb_intern_atom_cookie_t cookies[cnt];
 
-	for (i = 0; i < LENGTH(atoms); i++) {
+	for (i = 0; i < cnt; i++) {
 		cookies[i] = xcb_intern_atom(dpy, 0, strlen(names[i]), names[i]);
 		log_debug("Requesting atom %s", names[i]);
 	}
-	for (i = 0; i < LENGTH(atoms); i++) {
+	for (i = 0; i < cnt; i++) {
 		reply = xcb_intern_atom_reply(dpy, cookies[i], NULL);
 		if (reply) {
 			atoms[i] = reply->atom;
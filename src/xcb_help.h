@@ -22,13 +22,13 @@
 
 enum net_atom_enum { NET_WM_STATE_FULLSCREEN, NET_SUPPORTED, NET_WM_STATE,
 	NET_ACTIVE_WINDOW };
-enum wm_atom_enum { WM_DELETE_WINDOW, WM_PROTOCOLS };
+enum wm_atom_enum { WM_DELETE_WINDOW, WM_PROTOCOLS, WM_TAKE_FOCUS };
 
 
 void elevate_window(xcb_window_t win);
 void move_resize(xcb_window_t win, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
 void set_border_width(xcb_window_t win, uint16_t w);
-void get_atoms(const char **names, xcb_atom_t *atoms);
+void get_atoms(const char **names, xcb_atom_t *atoms, unsigned int cnt);
 void check_other_wm(void);
 void focus_window(xcb_window_t win);
 void grab_buttons(Client *c);
@@ -0,0 +1,159 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+
+#include "xlatency.h"
+#include "howm.h"
+#include "helper.h"
+#include "probes.h"
+#include "xstats.h"
+
+/**
+ * @file xlatency.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Measure the X server's round trip latency, to tell slowness in the
+ * server apart from slowness in howm.
+ *
+ * Every conf.xlatency_interval milliseconds, a GetInputFocus request is sent.
+ * It is about the cheapest request that has a reply. Its reply is collected
+ * without blocking, whenever the main loop wakes up, and the time taken is
+ * added to a histogram.
+ *
+ * The sequence numbers of events tell us which requests the server had
+ * processed when it sent them, so when a probe is sent the gap between its
+ * sequence number and that of the last event is the amount of requests that
+ * are still queued in (or on the way to) the server.
+ */
+
+static struct xlatency stats;
+static bool pending; /**< Is a probe waiting for its reply? */
+static unsigned int pending_seq; /**< The sequence number of the probe. */
+static uint64_t sent_us; /**< When the pending probe was sent. */
+static uint64_t next_us; /**< When the next probe is due, or 0 for now. */
+static uint32_t seen_seq; /**< The newest sequence number the server has
+			    reported. */
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void xlatency_record(uint32_t us, bool error)
+{
+	unsigned int b = 0;
+
+	if (error)
+		stats.errors++;
+	if (!stats.samples || us < stats.min_us)
+		stats.min_us = us;
+	if (us > stats.max_us)
+		stats.max_us = us;
+	stats.samples++;
+	stats.sum_us += us;
+	while (b < XLATENCY_BUCKETS - 1 && us > xlatency_bucket_bound(b))
+		b++;
+	stats.buckets[b]++;
+	PROBE2(xlatency, us, stats.last_gap);
+}
+
+/**
+ * @brief Collect the reply to the pending probe and send another once one is
+ * due. Never blocks.
+ */
+void xlatency_update(void)
+{
+	xcb_get_input_focus_reply_t *r = NULL;
+	xcb_generic_error_t *e = NULL;
+	uint64_t now;
+
+	if (pending) {
+		if (!xcb_poll_for_reply(dpy, pending_seq, (void **)&r, &e))
+			return;
+		xlatency_record(now_us() - sent_us, e != NULL);
+		xlatency_seen(pending_seq);
+		free(r);
+		free(e);
+		pending = false;
+		next_us = sent_us + conf.xlatency_interval * 1000;
+	}
+	if (!conf.xlatency_interval)
+		return;
+
+	now = now_us();
+	if (now < next_us)
+		return;
+	pending_seq = xcb_get_input_focus(dpy).sequence;
+	sent_us = now;
+	pending = true;
+	stats.last_gap = pending_seq > seen_seq + 1 && seen_seq ? pending_seq - seen_seq - 1 : 0;
+	if (stats.last_gap > stats.max_gap)
+		stats.max_gap = stats.last_gap;
+}
+
+/**
+ * @brief Note the sequence number of an event, which is that of the last
+ * request that the server had processed when it sent the event.
+ *
+ * @param sequence The full_sequence of the event.
+ */
+void xlatency_seen(uint32_t sequence)
+{
+	if (sequence > seen_seq)
+		seen_seq = sequence;
+}
+
+/**
+ * @brief How long the main loop may sleep before the next probe is due.
+ *
+ * @param tv Storage for the timeout.
+ * @param other The timeout that would otherwise be used, or NULL.
+ *
+ * @return Whichever of tv and other is sooner.
+ */
+struct timeval *xlatency_timeout(struct timeval *tv, struct timeval *other)
+{
+	uint64_t now = now_us(), us;
+
+	/* A pending probe wakes the main loop up when its reply arrives. */
+	if (!conf.xlatency_interval || pending)
+		return other;
+	us = next_us > now ? next_us - now : 0;
+	if (other && (uint64_t)other->tv_sec * 1000000 + other->tv_usec <= us)
+		return other;
+	tv->tv_sec = us / 1000000;
+	tv->tv_usec = us % 1000000;
+	return tv;
+}
+
+const struct xlatency *xlatency_get(void)
+{
+	return &stats;
+}
+
+/**
+ * @brief Get the upper bound of a histogram bucket.
+ *
+ * @return The bound in microseconds, or 0 for the last, unbounded, bucket.
+ */
+uint32_t xlatency_bucket_bound(unsigned int bucket)
+{
+	if (bucket >= XLATENCY_BUCKETS - 1)
+		return 0;
+	return XLATENCY_MIN_US << bucket;
+}
+
+void xlatency_reset(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
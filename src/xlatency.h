@@ -0,0 +1,45 @@
+#ifndef XLATENCY_H
+#define XLATENCY_H
+
+#include <stdint.h>
+#include <sys/time.h>
+
+/**
+ * @file xlatency.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/** The upper bound of the smallest histogram bucket, in microseconds. Each
+ * bucket after it is twice as large. */
+#define XLATENCY_MIN_US 16
+/** The amount of histogram buckets, the last of which is unbounded. */
+#define XLATENCY_BUCKETS 18
+
+/**
+ * @brief Round trip latencies of the X server, measured with GetInputFocus.
+ */
+struct xlatency {
+	uint32_t samples; /**< Round trips that have completed. */
+	uint32_t errors; /**< Round trips that returned an error. */
+	uint64_t sum_us; /**< The total latency of every round trip. */
+	uint32_t min_us;
+	uint32_t max_us;
+	uint32_t buckets[XLATENCY_BUCKETS]; /**< Round trips by latency. */
+	uint32_t last_gap; /**< Requests not yet processed when the last
+			probe was sent. */
+	uint32_t max_gap; /**< The most requests that haven't been processed. */
+};
+
+void xlatency_update(void);
+void xlatency_seen(uint32_t sequence);
+struct timeval *xlatency_timeout(struct timeval *tv, struct timeval *other);
+const struct xlatency *xlatency_get(void);
+uint32_t xlatency_bucket_bound(unsigned int bucket);
+void xlatency_reset(void);
+
+#endif
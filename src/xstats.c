@@ -0,0 +1,297 @@
+#include <stdint.h>
+#include <string.h>
+#include <xcb/xcb.h>
+
+#include "xstats.h"
+#include "ipc.h"
+#include "howm.h"
+#include "helper.h"
+
+/**
+ * @file xstats.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Count the X requests that howm makes, along with the operation (an
+ * IPC command or an X event) that caused them.
+ *
+ * This makes it easy to see how expensive an operation is in terms of X
+ * traffic and to spot operations that block waiting for a reply.
+ *
+ * Operations that are performed often have a budget. A call that goes over
+ * its budget is logged and counted, so that a change which makes an
+ * operation send more requests per client (or wait for a reply) is noticed
+ * straight away.
+ */
+
+static struct xstats_op ops[XSTATS_OPS];
+static unsigned int cur_op = XSTATS_OTHER;
+static uint32_t start_requests;
+static uint32_t start_round_trips;
+static int start_ws;
+static unsigned int start_clients;
+
+/* The budgets are slightly above what each operation costs at the moment.
+ * If a change makes an operation cheaper, lower its budget to match. */
+static const struct xstats_budget budgets[XSTATS_OPS] = {
+	[XSTATS_IPC(IPC_OP_MOVE_CURRENT_DOWN)] = { 4, 1, 0 },
+	[XSTATS_IPC(IPC_OP_MOVE_CURRENT_UP)] = { 4, 1, 0 },
+	[XSTATS_IPC(IPC_OP_FOCUS_NEXT_CLIENT)] = { 6, 3, 0 },
+	[XSTATS_IPC(IPC_OP_FOCUS_PREV_CLIENT)] = { 6, 3, 0 },
+	[XSTATS_IPC(IPC_OP_TOGGLE_FLOAT)] = { 4, 1, 0 },
+	[XSTATS_IPC(IPC_OP_TOGGLE_FULLSCREEN)] = { 4, 2, 0 },
+	[XSTATS_IPC(IPC_OP_FOCUS_URGENT)] = { 8, 3, 0 },
+	[XSTATS_IPC(IPC_OP_MAKE_MASTER)] = { 6, 3, 0 },
+	[XSTATS_IPC(IPC_OP_TOGGLE_BAR)] = { 4, 1, 0 },
+	[XSTATS_IPC(IPC_OP_RESIZE_MASTER)] = { 4, 1, 0 },
+	[XSTATS_IPC(IPC_OP_FOCUS_NEXT_WS)] = { 8, 3, 0 },
+	[XSTATS_IPC(IPC_OP_FOCUS_PREV_WS)] = { 8, 3, 0 },
+	[XSTATS_IPC(IPC_OP_FOCUS_LAST_WS)] = { 8, 3, 0 },
+	[XSTATS_IPC(IPC_OP_CHANGE_WS)] = { 8, 3, 0 },
+	[XSTATS_IPC(IPC_OP_PASTE)] = { 10, 3, 0 },
+	[XSTATS_IPC(IPC_OP_CHANGE_LAYOUT)] = { 6, 3, 0 },
+	[XSTATS_IPC(IPC_OP_NEXT_LAYOUT)] = { 6, 3, 0 },
+	[XSTATS_IPC(IPC_OP_PREV_LAYOUT)] = { 6, 3, 0 },
+	[XSTATS_IPC(IPC_OP_LAST_LAYOUT)] = { 6, 3, 0 },
+	[XSTATS_IPC(IPC_OP_OP_KILL)] = { 6, 3, 0 },
+	[XSTATS_IPC(IPC_OP_OP_MOVE_UP)] = { 4, 1, 0 },
+	[XSTATS_IPC(IPC_OP_OP_MOVE_DOWN)] = { 4, 1, 0 },
+	[XSTATS_IPC(IPC_OP_OP_FOCUS_DOWN)] = { 6, 3, 0 },
+	[XSTATS_IPC(IPC_OP_OP_FOCUS_UP)] = { 6, 3, 0 },
+	[XSTATS_IPC(IPC_OP_OP_SHRINK_GAPS)] = { 4, 2, 0 },
+	[XSTATS_IPC(IPC_OP_OP_GROW_GAPS)] = { 4, 2, 0 },
+	[XSTATS_IPC(IPC_OP_OP_CUT)] = { 6, 3, 0 },
+	[XSTATS_IPC(IPC_OP_OPERATE)] = { 6, 3, 0 },
+	[XSTATS_EVENT(XCB_MAP_REQUEST)] = { 16, 3, 0 },
+	[XSTATS_EVENT(XCB_DESTROY_NOTIFY)] = { 8, 3, 0 },
+	[XSTATS_EVENT(XCB_UNMAP_NOTIFY)] = { 8, 3, 0 },
+	[XSTATS_EVENT(XCB_ENTER_NOTIFY)] = { 6, 3, 0 },
+	[XSTATS_EVENT(XCB_CLIENT_MESSAGE)] = { 8, 3, 0 },
+	[XSTATS_EVENT(XCB_PROPERTY_NOTIFY)] = { 1, 0, 0 },
+};
+
+static const char *event_names[XSTATS_EVENTS] = {
+	[0] = "error",
+	[XCB_KEY_PRESS] = "key_press",
+	[XCB_KEY_RELEASE] = "key_release",
+	[XCB_BUTTON_PRESS] = "button_press",
+	[XCB_BUTTON_RELEASE] = "button_release",
+	[XCB_MOTION_NOTIFY] = "motion_notify",
+	[XCB_ENTER_NOTIFY] = "enter_notify",
+	[XCB_LEAVE_NOTIFY] = "leave_notify",
+	[XCB_FOCUS_IN] = "focus_in",
+	[XCB_FOCUS_OUT] = "focus_out",
+	[XCB_EXPOSE] = "expose",
+	[XCB_CREATE_NOTIFY] = "create_notify",
+	[XCB_DESTROY_NOTIFY] = "destroy_notify",
+	[XCB_UNMAP_NOTIFY] = "unmap_notify",
+	[XCB_MAP_NOTIFY] = "map_notify",
+	[XCB_MAP_REQUEST] = "map_request",
+	[XCB_REPARENT_NOTIFY] = "reparent_notify",
+	[XCB_CONFIGURE_NOTIFY] = "configure_notify",
+	[XCB_CONFIGURE_REQUEST] = "configure_request",
+	[XCB_PROPERTY_NOTIFY] = "property_notify",
+	[XCB_CLIENT_MESSAGE] = "client_message",
+	[XCB_MAPPING_NOTIFY] = "mapping_notify",
+};
+
+static const char *opcode_names[XSTATS_OPCODES] = {
+	[XCB_CHANGE_WINDOW_ATTRIBUTES] = "ChangeWindowAttributes",
+	[XCB_GET_WINDOW_ATTRIBUTES] = "GetWindowAttributes",
+	[XCB_MAP_WINDOW] = "MapWindow",
+	[XCB_UNMAP_WINDOW] = "UnmapWindow",
+	[XCB_CONFIGURE_WINDOW] = "ConfigureWindow",
+	[XCB_GET_GEOMETRY] = "GetGeometry",
+	[XCB_QUERY_TREE] = "QueryTree",
+	[XCB_INTERN_ATOM] = "InternAtom",
+	[XCB_CHANGE_PROPERTY] = "ChangeProperty",
+	[XCB_GET_PROPERTY] = "GetProperty",
+	[XCB_SEND_EVENT] = "SendEvent",
+	[XCB_GRAB_BUTTON] = "GrabButton",
+	[XCB_UNGRAB_BUTTON] = "UngrabButton",
+	[XCB_GRAB_KEY] = "GrabKey",
+	[XCB_UNGRAB_KEY] = "UngrabKey",
+	[XCB_ALLOW_EVENTS] = "AllowEvents",
+	[XCB_SET_INPUT_FOCUS] = "SetInputFocus",
+	[XCB_GET_INPUT_FOCUS] = "GetInputFocus",
+	[XCB_ALLOC_COLOR] = "AllocColor",
+	[XCB_KILL_CLIENT] = "KillClient",
+	[XCB_GET_MODIFIER_MAPPING] = "GetModifierMapping",
+};
+
+/**
+ * @brief Attribute the requests that follow to an operation.
+ *
+ * @param op The operation, made with XSTATS_IPC or XSTATS_EVENT.
+ */
+void xstats_begin(unsigned int op)
+{
+	if (op >= XSTATS_OPS)
+		op = XSTATS_OTHER;
+	ops[op].calls++;
+	xstats_resume(op);
+}
+
+/**
+ * @brief Attribute the requests that follow to an operation, without counting
+ * another call of it. This is for work that an earlier call deferred.
+ *
+ * @param op The operation, made with XSTATS_IPC or XSTATS_EVENT.
+ */
+void xstats_resume(unsigned int op)
+{
+	if (op >= XSTATS_OPS)
+		op = XSTATS_OTHER;
+	cur_op = op;
+	start_requests = ops[op].requests;
+	start_round_trips = ops[op].round_trips;
+	start_ws = cw;
+	start_clients = wss[cw].client_cnt;
+}
+
+/**
+ * @brief Check whether a call of the current operation went over its budget.
+ *
+ * @param requests The amount of requests that the call made.
+ * @param round_trips The amount of round trips that the call made.
+ */
+static void xstats_check_budget(uint32_t requests, uint32_t round_trips)
+{
+	const struct xstats_budget *b = &budgets[cur_op];
+	unsigned int clients = wss[cw].client_cnt;
+	uint32_t limit;
+
+	if (!b->fixed && !b->per_client)
+		return;
+	/* Count the clients on both workspaces if the operation moved between
+	 * them, otherwise whichever is larger of before and after. */
+	if (cw != start_ws)
+		clients += start_clients;
+	else if (start_clients > clients)
+		clients = start_clients;
+
+	limit = b->fixed + b->per_client * clients;
+	if (requests <= limit && round_trips <= b->round_trips)
+		return;
+	ops[cur_op].over_budget++;
+	log_warn("%s made %u requests and %u round trips with %u clients, its budget is %u and %u",
+			xstats_op_name(cur_op), requests, round_trips, clients,
+			limit, b->round_trips);
+}
+
+/**
+ * @brief Finish the current operation, recording how much a single call of it
+ * cost.
+ */
+void xstats_end(void)
+{
+	struct xstats_op *o = &ops[cur_op];
+	uint32_t requests = o->requests - start_requests;
+	uint32_t round_trips = o->round_trips - start_round_trips;
+
+	if (cur_op != XSTATS_OTHER) {
+		if (requests > o->max_requests)
+			o->max_requests = requests;
+		if (round_trips > o->max_round_trips)
+			o->max_round_trips = round_trips;
+		xstats_check_budget(requests, round_trips);
+	}
+	cur_op = XSTATS_OTHER;
+}
+
+/**
+ * @brief Get the operation that requests are currently attributed to.
+ *
+ * @return The operation, or XSTATS_OTHER outside of one.
+ */
+unsigned int xstats_current(void)
+{
+	return cur_op;
+}
+
+/**
+ * @brief Count a request against the current operation.
+ *
+ * @param opcode The major opcode of the request.
+ */
+void xstats_request(uint8_t opcode)
+{
+	ops[cur_op].requests++;
+	ops[cur_op].by_opcode[opcode % XSTATS_OPCODES]++;
+}
+
+/**
+ * @brief Count a blocking wait for a reply against the current operation.
+ */
+void xstats_round_trip(void)
+{
+	ops[cur_op].round_trips++;
+}
+
+/**
+ * @brief Forget everything that has been counted.
+ */
+void xstats_reset(void)
+{
+	memset(ops, 0, sizeof(ops));
+	start_requests = start_round_trips = 0;
+}
+
+/**
+ * @brief Get the counts for an operation.
+ *
+ * @param op The operation.
+ *
+ * @return The counts, or NULL if op isn't valid.
+ */
+const struct xstats_op *xstats_get(unsigned int op)
+{
+	return op < XSTATS_OPS ? &ops[op] : NULL;
+}
+
+/**
+ * @brief Get the budget for an operation.
+ *
+ * @param op The operation.
+ *
+ * @return The budget, or NULL if op doesn't have one.
+ */
+const struct xstats_budget *xstats_get_budget(unsigned int op)
+{
+	if (op >= XSTATS_OPS || (!budgets[op].fixed && !budgets[op].per_client))
+		return NULL;
+	return &budgets[op];
+}
+
+/**
+ * @brief Get the name of an operation.
+ *
+ * @param op The operation.
+ *
+ * @return The name of the IPC command or X event, or NULL if it doesn't have
+ * one.
+ */
+const char *xstats_op_name(unsigned int op)
+{
+	if (op == XSTATS_OTHER)
+		return "other";
+	else if (op < IPC_OP_END)
+		return ipc_command_name(op);
+	else if (op < XSTATS_OPS)
+		return event_names[op - IPC_OP_END];
+	return NULL;
+}
+
+/**
+ * @brief Get the name of a request opcode, as used by the X protocol.
+ *
+ * @param opcode The major opcode of the request.
+ *
+ * @return The name, or NULL if howm never makes the request.
+ */
+const char *xstats_opcode_name(unsigned int opcode)
+{
+	return opcode < XSTATS_OPCODES ? opcode_names[opcode] : NULL;
+}
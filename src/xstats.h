@@ -0,0 +1,165 @@
+#ifndef XSTATS_H
+#define XSTATS_H
+
+#include <stdint.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_ewmh.h>
+#include <xcb/xcb_icccm.h>
+
+#include "ipc.h"
+
+/**
+ * @file xstats.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/** Core request opcodes are all below 128. */
+#define XSTATS_OPCODES 128
+/** The amount of core event types, including XCB_GE_GENERIC. */
+#define XSTATS_EVENTS (XCB_GE_GENERIC + 1)
+
+/** Work that isn't caused by a command or an event, such as setting up. */
+#define XSTATS_OTHER 0
+/** The operation for an IPC command, from ipc_opcodes. */
+#define XSTATS_IPC(op) (op)
+/** The operation for handling an X event of the given type. */
+#define XSTATS_EVENT(type) (IPC_OP_END + ((type) & ~0x80))
+/** The amount of operations that requests are attributed to. */
+#define XSTATS_OPS (IPC_OP_END + XSTATS_EVENTS)
+
+/**
+ * @brief The X requests made while performing an operation.
+ */
+struct xstats_op {
+	uint32_t calls; /**< How many times the operation has been performed. */
+	uint32_t requests; /**< The total amount of requests sent. */
+	uint32_t round_trips; /**< The total amount of blocking reply waits. */
+	uint32_t max_requests; /**< The most requests sent by a single call. */
+	uint32_t max_round_trips; /**< The most round trips made by a single call. */
+	uint32_t over_budget; /**< How many calls have exceeded the budget. */
+	uint32_t by_opcode[XSTATS_OPCODES]; /**< Requests, by opcode. */
+};
+
+/**
+ * @brief The most X traffic that a single call of an operation should cause.
+ *
+ * Request budgets scale with the amount of clients on the workspaces that the
+ * operation touches, as most operations redraw every client.
+ */
+struct xstats_budget {
+	uint16_t fixed; /**< Requests allowed no matter how many clients there are. */
+	uint16_t per_client; /**< Requests allowed for each client. */
+	uint16_t round_trips; /**< Blocking reply waits allowed. */
+};
+
+void xstats_begin(unsigned int op);
+void xstats_resume(unsigned int op);
+void xstats_end(void);
+unsigned int xstats_current(void);
+void xstats_request(uint8_t opcode);
+void xstats_round_trip(void);
+void xstats_reset(void);
+const struct xstats_op *xstats_get(unsigned int op);
+const struct xstats_budget *xstats_get_budget(unsigned int op);
+const char *xstats_op_name(unsigned int op);
+const char *xstats_opcode_name(unsigned int opcode);
+
+/* Every request and blocking reply made by howm goes through the wrappers
+ * below, so that it is counted without cluttering the call sites. A macro
+ * isn't expanded inside of itself, so each wrapper calls the real function.
+ *
+ * This header must be included after the XCB headers, which it includes
+ * itself to make that easy. Functions that are only used while setting up
+ * (such as xcb_ewmh_init_atoms) are deliberately left alone.
+ *
+ * Code that makes requests on a connection other than howm's own defines
+ * XSTATS_NO_WRAPPERS before including this header, so that it only counts
+ * the requests it makes on dpy. */
+
+#ifndef XSTATS_NO_WRAPPERS
+
+#define XSTATS_REQ(opcode, call) (xstats_request(opcode), call)
+#define XSTATS_WAIT(call) (xstats_round_trip(), call)
+
+#define xcb_change_window_attributes(...) \
+	XSTATS_REQ(XCB_CHANGE_WINDOW_ATTRIBUTES, xcb_change_window_attributes(__VA_ARGS__))
+#define xcb_change_window_attributes_checked(...) \
+	XSTATS_REQ(XCB_CHANGE_WINDOW_ATTRIBUTES, xcb_change_window_attributes_checked(__VA_ARGS__))
+#define xcb_get_window_attributes(...) \
+	XSTATS_REQ(XCB_GET_WINDOW_ATTRIBUTES, xcb_get_window_attributes(__VA_ARGS__))
+#define xcb_map_window(...) XSTATS_REQ(XCB_MAP_WINDOW, xcb_map_window(__VA_ARGS__))
+#define xcb_unmap_window(...) XSTATS_REQ(XCB_UNMAP_WINDOW, xcb_unmap_window(__VA_ARGS__))
+#define xcb_configure_window(...) \
+	XSTATS_REQ(XCB_CONFIGURE_WINDOW, xcb_configure_window(__VA_ARGS__))
+#define xcb_get_geometry_unchecked(...) \
+	XSTATS_REQ(XCB_GET_GEOMETRY, xcb_get_geometry_unchecked(__VA_ARGS__))
+#define xcb_query_tree(...) XSTATS_REQ(XCB_QUERY_TREE, xcb_query_tree(__VA_ARGS__))
+#define xcb_intern_atom(...) XSTATS_REQ(XCB_INTERN_ATOM, xcb_intern_atom(__VA_ARGS__))
+#define xcb_change_property(...) \
+	XSTATS_REQ(XCB_CHANGE_PROPERTY, xcb_change_property(__VA_ARGS__))
+#define xcb_send_event(...) XSTATS_REQ(XCB_SEND_EVENT, xcb_send_event(__VA_ARGS__))
+#define xcb_grab_button(...) XSTATS_REQ(XCB_GRAB_BUTTON, xcb_grab_button(__VA_ARGS__))
+#define xcb_ungrab_button(...) XSTATS_REQ(XCB_UNGRAB_BUTTON, xcb_ungrab_button(__VA_ARGS__))
+#define xcb_allow_events(...) XSTATS_REQ(XCB_ALLOW_EVENTS, xcb_allow_events(__VA_ARGS__))
+#define xcb_set_input_focus(...) \
+	XSTATS_REQ(XCB_SET_INPUT_FOCUS, xcb_set_input_focus(__VA_ARGS__))
+#define xcb_alloc_color(...) XSTATS_REQ(XCB_ALLOC_COLOR, xcb_alloc_color(__VA_ARGS__))
+#define xcb_kill_client(...) XSTATS_REQ(XCB_KILL_CLIENT, xcb_kill_client(__VA_ARGS__))
+#define xcb_grab_key(...) XSTATS_REQ(XCB_GRAB_KEY, xcb_grab_key(__VA_ARGS__))
+#define xcb_ungrab_key(...) XSTATS_REQ(XCB_UNGRAB_KEY, xcb_ungrab_key(__VA_ARGS__))
+#define xcb_get_modifier_mapping(...) \
+	XSTATS_REQ(XCB_GET_MODIFIER_MAPPING, xcb_get_modifier_mapping(__VA_ARGS__))
+#define xcb_get_input_focus(...) \
+	XSTATS_REQ(XCB_GET_INPUT_FOCUS, xcb_get_input_focus(__VA_ARGS__))
+
+#define xcb_ewmh_set_workarea(...) \
+	XSTATS_REQ(XCB_CHANGE_PROPERTY, xcb_ewmh_set_workarea(__VA_ARGS__))
+#define xcb_ewmh_set_frame_extents(...) \
+	XSTATS_REQ(XCB_CHANGE_PROPERTY, xcb_ewmh_set_frame_extents(__VA_ARGS__))
+#define xcb_ewmh_set_current_desktop(...) \
+	XSTATS_REQ(XCB_CHANGE_PROPERTY, xcb_ewmh_set_current_desktop(__VA_ARGS__))
+#define xcb_ewmh_set_active_window(...) \
+	XSTATS_REQ(XCB_CHANGE_PROPERTY, xcb_ewmh_set_active_window(__VA_ARGS__))
+#define xcb_ewmh_set_wm_name(...) \
+	XSTATS_REQ(XCB_CHANGE_PROPERTY, xcb_ewmh_set_wm_name(__VA_ARGS__))
+#define xcb_ewmh_set_supporting_wm_check(...) \
+	XSTATS_REQ(XCB_CHANGE_PROPERTY, xcb_ewmh_set_supporting_wm_check(__VA_ARGS__))
+#define xcb_ewmh_set_supported(...) \
+	XSTATS_REQ(XCB_CHANGE_PROPERTY, xcb_ewmh_set_supported(__VA_ARGS__))
+#define xcb_ewmh_set_number_of_desktops(...) \
+	XSTATS_REQ(XCB_CHANGE_PROPERTY, xcb_ewmh_set_number_of_desktops(__VA_ARGS__))
+#define xcb_ewmh_set_desktop_viewport(...) \
+	XSTATS_REQ(XCB_CHANGE_PROPERTY, xcb_ewmh_set_desktop_viewport(__VA_ARGS__))
+#define xcb_ewmh_set_desktop_geometry(...) \
+	XSTATS_REQ(XCB_CHANGE_PROPERTY, xcb_ewmh_set_desktop_geometry(__VA_ARGS__))
+#define xcb_ewmh_get_wm_window_type(...) \
+	XSTATS_REQ(XCB_GET_PROPERTY, xcb_ewmh_get_wm_window_type(__VA_ARGS__))
+#define xcb_icccm_get_wm_protocols(...) \
+	XSTATS_REQ(XCB_GET_PROPERTY, xcb_icccm_get_wm_protocols(__VA_ARGS__))
+#define xcb_icccm_get_wm_transient_for_unchecked(...) \
+	XSTATS_REQ(XCB_GET_PROPERTY, xcb_icccm_get_wm_transient_for_unchecked(__VA_ARGS__))
+
+#define xcb_request_check(...) XSTATS_WAIT(xcb_request_check(__VA_ARGS__))
+#define xcb_get_window_attributes_reply(...) \
+	XSTATS_WAIT(xcb_get_window_attributes_reply(__VA_ARGS__))
+#define xcb_get_geometry_reply(...) XSTATS_WAIT(xcb_get_geometry_reply(__VA_ARGS__))
+#define xcb_query_tree_reply(...) XSTATS_WAIT(xcb_query_tree_reply(__VA_ARGS__))
+#define xcb_intern_atom_reply(...) XSTATS_WAIT(xcb_intern_atom_reply(__VA_ARGS__))
+#define xcb_alloc_color_reply(...) XSTATS_WAIT(xcb_alloc_color_reply(__VA_ARGS__))
+#define xcb_get_modifier_mapping_reply(...) \
+	XSTATS_WAIT(xcb_get_modifier_mapping_reply(__VA_ARGS__))
+#define xcb_ewmh_get_wm_window_type_reply(...) \
+	XSTATS_WAIT(xcb_ewmh_get_wm_window_type_reply(__VA_ARGS__))
+#define xcb_icccm_get_wm_protocols_reply(...) \
+	XSTATS_WAIT(xcb_icccm_get_wm_protocols_reply(__VA_ARGS__))
+#define xcb_icccm_get_wm_transient_for_reply(...) \
+	XSTATS_WAIT(xcb_icccm_get_wm_transient_for_reply(__VA_ARGS__))
+
+#endif /* XSTATS_NO_WRAPPERS */
+
+#endif
@@ -0,0 +1,550 @@
+#define _GNU_SOURCE
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_ewmh.h>
+#include <xcb/xcb_icccm.h>
+
+#include "xworker.h"
+#include "howm.h"
+#include "helper.h"
+#include "handler.h"
+#include "client.h"
+#include "ipc.h"
+#include "xcb_help.h"
+/* The worker makes its requests on a connection of its own, which mustn't be
+ * counted as howm's. */
+#define XSTATS_NO_WRAPPERS
+#include "xstats.h"
+
+/**
+ * @file xworker.c
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief Fetch the properties of windows on a second X connection, so that
+ * the main thread never waits for a reply.
+ *
+ * When a window asks to be mapped, howm needs its attributes, type,
+ * WM_TRANSIENT_FOR, geometry and WM_PROTOCOLS before it can be managed, and
+ * a client's WM_PROTOCOLS must be fetched again whenever they change. Each
+ * of these is a round trip to the X server, which used to stall every other
+ * event and IPC command until it was answered.
+ *
+ * Instead, the main thread submits a job to a worker thread, which has its
+ * own X connection. The worker sends the requests for every job that is
+ * waiting at once, then collects the replies, so a burst of new windows costs
+ * a single round trip on its connection. Finished jobs are passed back to the
+ * main thread, which is woken by an eventfd and manages the windows in the
+ * order that they asked to be mapped.
+ *
+ * Jobs are kept in a single ring with three indices: the main thread submits
+ * jobs at head, the worker finishes them up to done and the main thread
+ * consumes the results up to tail. Each index has one writer, so no locks are
+ * needed. If the ring is full or the worker couldn't be started, a job is
+ * run on the main thread's connection instead.
+ */
+
+/**
+ * @brief The jobs that have been submitted to the worker.
+ */
+struct xworker_queue {
+	struct xworker_job jobs[XWORKER_QUEUE_SIZE];
+	unsigned int head; /**< Only written by the main thread. */
+	unsigned int done; /**< Only written by the worker. */
+	unsigned int tail; /**< Only written by the main thread. */
+};
+
+/**
+ * @brief The requests that have been sent for a job, whose replies haven't
+ * been collected yet.
+ */
+struct xworker_cookies {
+	xcb_get_window_attributes_cookie_t wa;
+	xcb_get_property_cookie_t type;
+	xcb_get_property_cookie_t transient;
+	xcb_get_geometry_cookie_t geom;
+	xcb_get_property_cookie_t protocols;
+};
+
+static const char *job_names[XWORKER_JOBS_END] = {
+	[XWORKER_MANAGE] = "manage",
+	[XWORKER_PROTOCOLS] = "protocols",
+};
+
+static xcb_connection_t *wdpy;
+static xcb_ewmh_connection_t wewmh;
+static int wake_main = -1; /**< Signalled when jobs have been finished. */
+static int wake_worker = -1; /**< Signalled when jobs have been submitted. */
+static pthread_t thread;
+static bool started;
+static bool stop;
+static bool broken; /**< Has the worker lost its connection? */
+
+static struct xworker_queue queue;
+static struct xworker_stats stats;
+
+/* Only used by the worker. */
+static struct xworker_cookies cookies[XWORKER_QUEUE_SIZE];
+
+static void signal_fd(int fd)
+{
+	uint64_t one = 1;
+
+	if (write(fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+		log_err("Unable to signal an eventfd. errno: %d", errno);
+}
+
+static void clear_fd(int fd)
+{
+	uint64_t n;
+
+	if (read(fd, &n, sizeof(n)) == -1 && errno != EAGAIN)
+		log_err("Unable to read an eventfd. errno: %d", errno);
+}
+
+/**
+ * @brief Send the requests that a job needs, without waiting for the replies.
+ *
+ * @param c The connection to send the requests on.
+ * @param e The EWMH connection that wraps c.
+ * @param j The job.
+ * @param ck Where to store the cookies of the requests.
+ */
+static void xworker_send(xcb_connection_t *c, xcb_ewmh_connection_t *e,
+		const struct xworker_job *j, struct xworker_cookies *ck)
+{
+	switch (j->type) {
+	case XWORKER_MANAGE:
+		ck->wa = xcb_get_window_attributes(c, j->win);
+		ck->type = xcb_ewmh_get_wm_window_type(e, j->win);
+		ck->transient = xcb_icccm_get_wm_transient_for_unchecked(c, j->win);
+		ck->geom = xcb_get_geometry_unchecked(c, j->win);
+		ck->protocols = xcb_icccm_get_wm_protocols(c, j->win,
+				wm_atoms[WM_PROTOCOLS]);
+		break;
+	case XWORKER_PROTOCOLS:
+		ck->protocols = xcb_icccm_get_wm_protocols(c, j->win,
+				wm_atoms[WM_PROTOCOLS]);
+		break;
+	}
+}
+
+/**
+ * @brief Collect a window's WM_PROTOCOLS.
+ *
+ * @param c The connection that the request was sent on.
+ * @param e The EWMH connection that wraps c.
+ * @param cookie The cookie of the request.
+ *
+ * @return The protocols that the window supports, from wm_protocols.
+ */
+static uint8_t xworker_get_protocols(xcb_connection_t *c,
+		xcb_ewmh_connection_t *e, xcb_get_property_cookie_t cookie)
+{
+	xcb_icccm_get_wm_protocols_reply_t rep;
+	uint8_t protocols = 0;
+	unsigned int i;
+
+	if (!xcb_icccm_get_wm_protocols_reply(c, cookie, &rep, NULL))
+		return 0;
+	for (i = 0; i < rep.atoms_len; ++i) {
+		if (rep.atoms[i] == wm_atoms[WM_DELETE_WINDOW])
+			protocols |= WM_PROTO_DELETE_WINDOW;
+		else if (rep.atoms[i] == wm_atoms[WM_TAKE_FOCUS])
+			protocols |= WM_PROTO_TAKE_FOCUS;
+		else if (rep.atoms[i] == e->_NET_WM_PING)
+			protocols |= WM_PROTO_PING;
+		else if (rep.atoms[i] == e->_NET_WM_SYNC_REQUEST)
+			protocols |= WM_PROTO_SYNC_REQUEST;
+	}
+	xcb_icccm_get_wm_protocols_reply_wipe(&rep);
+	return protocols;
+}
+
+/**
+ * @brief Collect the replies to a job's requests and store the results.
+ *
+ * @param c The connection that the requests were sent on.
+ * @param e The EWMH connection that wraps c.
+ * @param j The job.
+ * @param ck The cookies of the job's requests.
+ */
+static void xworker_collect(xcb_connection_t *c, xcb_ewmh_connection_t *e,
+		struct xworker_job *j, struct xworker_cookies *ck)
+{
+	xcb_get_window_attributes_reply_t *wa;
+	xcb_get_geometry_reply_t *geom;
+	xcb_ewmh_get_atoms_reply_t type;
+	xcb_window_t transient = 0;
+	unsigned int i;
+
+	switch (j->type) {
+	case XWORKER_MANAGE:
+		wa = xcb_get_window_attributes_reply(c, ck->wa, NULL);
+		if (wa) {
+			j->exists = true;
+			j->override_redirect = wa->override_redirect;
+			free(wa);
+		}
+		if (xcb_ewmh_get_wm_window_type_reply(e, ck->type, &type, NULL) == 1) {
+			for (i = 0; i < type.atoms_len; i++) {
+				xcb_atom_t a = type.atoms[i];
+
+				if (a == e->_NET_WM_WINDOW_TYPE_DOCK
+					|| a == e->_NET_WM_WINDOW_TYPE_TOOLBAR) {
+					j->dock = true;
+				} else if (a == e->_NET_WM_WINDOW_TYPE_NOTIFICATION
+					|| a == e->_NET_WM_WINDOW_TYPE_DROPDOWN_MENU
+					|| a == e->_NET_WM_WINDOW_TYPE_SPLASH
+					|| a == e->_NET_WM_WINDOW_TYPE_POPUP_MENU
+					|| a == e->_NET_WM_WINDOW_TYPE_TOOLTIP
+					|| a == e->_NET_WM_WINDOW_TYPE_DIALOG) {
+					j->floating = true;
+				}
+			}
+			xcb_ewmh_get_atoms_reply_wipe(&type);
+		}
+		xcb_icccm_get_wm_transient_for_reply(c, ck->transient, &transient, NULL);
+		j->transient = transient ? true : false;
+		geom = xcb_get_geometry_reply(c, ck->geom, NULL);
+		if (geom) {
+			j->has_geom = true;
+			j->x = geom->x;
+			j->y = geom->y;
+			j->w = geom->width;
+			j->h = geom->height;
+			free(geom);
+		}
+		j->protocols = xworker_get_protocols(c, e, ck->protocols);
+		break;
+	case XWORKER_PROTOCOLS:
+		j->protocols = xworker_get_protocols(c, e, ck->protocols);
+		break;
+	}
+	if (xcb_connection_has_error(c))
+		j->failed = true;
+}
+
+static void *xworker_run(void *arg)
+{
+	xcb_generic_event_t *ev;
+	unsigned int i, head;
+
+	UNUSED(arg);
+	while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE)) {
+		/* wake_worker blocks, so this sleeps until a job is submitted. */
+		clear_fd(wake_worker);
+		head = __atomic_load_n(&queue.head, __ATOMIC_ACQUIRE);
+		if (queue.done == head)
+			continue;
+		for (i = queue.done; i != head; i++)
+			xworker_send(wdpy, &wewmh, &queue.jobs[i % XWORKER_QUEUE_SIZE],
+					&cookies[i % XWORKER_QUEUE_SIZE]);
+		xcb_flush(wdpy);
+		for (i = queue.done; i != head; i++)
+			xworker_collect(wdpy, &wewmh, &queue.jobs[i % XWORKER_QUEUE_SIZE],
+					&cookies[i % XWORKER_QUEUE_SIZE]);
+		xcb_flush(wdpy);
+		/* No events are selected on this connection, but errors caused by
+		 * windows that have already gone can end up here. */
+		while ((ev = xcb_poll_for_event(wdpy)))
+			free(ev);
+		__atomic_store_n(&queue.done, head, __ATOMIC_RELEASE);
+		signal_fd(wake_main);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Count the requests that a job made on howm's own connection.
+ *
+ * @param j A job that has been run on the main thread.
+ */
+static void xworker_count(const struct xworker_job *j)
+{
+	unsigned int i;
+
+	switch (j->type) {
+	case XWORKER_MANAGE:
+		xstats_request(XCB_GET_WINDOW_ATTRIBUTES);
+		xstats_request(XCB_GET_PROPERTY);
+		xstats_request(XCB_GET_PROPERTY);
+		xstats_request(XCB_GET_GEOMETRY);
+		xstats_request(XCB_GET_PROPERTY);
+		for (i = 0; i < 5; i++)
+			xstats_round_trip();
+		break;
+	case XWORKER_PROTOCOLS:
+		xstats_request(XCB_GET_PROPERTY);
+		xstats_round_trip();
+		break;
+	}
+}
+
+/**
+ * @brief Run a job on howm's own connection, waiting for the replies.
+ *
+ * @param j The job.
+ */
+static void xworker_run_sync(struct xworker_job *j)
+{
+	struct xworker_cookies ck;
+	uint8_t type = j->type;
+	xcb_window_t win = j->win;
+	int ws = j->ws;
+
+	memset(j, 0, sizeof(*j));
+	j->type = type;
+	j->win = win;
+	j->ws = ws;
+	xworker_send(dpy, ewmh, j, &ck);
+	xworker_collect(dpy, ewmh, j, &ck);
+	xworker_count(j);
+	stats.sync++;
+}
+
+/**
+ * @brief Hand a job to the worker.
+ *
+ * @param type The kind of job, from xworker_jobs.
+ * @param win The window that the job is about.
+ *
+ * @return Whether the job was submitted. If not, it must be run on the main
+ * thread.
+ */
+static bool xworker_submit(uint8_t type, xcb_window_t win)
+{
+	struct xworker_job *j;
+
+	if (!started || broken || queue.head - queue.tail >= XWORKER_QUEUE_SIZE)
+		return false;
+	j = &queue.jobs[queue.head % XWORKER_QUEUE_SIZE];
+	memset(j, 0, sizeof(*j));
+	j->type = type;
+	j->win = win;
+	j->ws = cw;
+	__atomic_store_n(&queue.head, queue.head + 1, __ATOMIC_RELEASE);
+	signal_fd(wake_worker);
+	return true;
+}
+
+/**
+ * @brief Open the worker's connection and start it.
+ *
+ * This must be called once the atoms and EWMH have been set up. If the worker
+ * can't be started, every job is run on the main thread instead.
+ */
+void xworker_init(void)
+{
+	wdpy = xcb_connect(NULL, NULL);
+	if (xcb_connection_has_error(wdpy)) {
+		log_warn("Can't open a second X connection, properties will be fetched synchronously");
+		xcb_disconnect(wdpy);
+		wdpy = NULL;
+		return;
+	}
+	fcntl(xcb_get_file_descriptor(wdpy), F_SETFD, FD_CLOEXEC);
+	/* The atoms are the same on every connection. */
+	wewmh = *ewmh;
+	wewmh.connection = wdpy;
+
+	wake_main = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	wake_worker = eventfd(0, EFD_CLOEXEC);
+	if (wake_main == -1 || wake_worker == -1) {
+		log_err("Couldn't create eventfds for the X worker. errno: %d", errno);
+		xworker_cleanup();
+		return;
+	}
+	if (pthread_create(&thread, NULL, xworker_run, NULL) != 0) {
+		log_err("Couldn't start the X worker.");
+		xworker_cleanup();
+		return;
+	}
+	started = true;
+}
+
+/**
+ * @brief Fetch the properties of a window that wants to be mapped, then
+ * manage it with manage_window().
+ *
+ * If the worker can't take the job, the window is managed straight away.
+ *
+ * @param win The window.
+ */
+void xworker_manage(xcb_window_t win)
+{
+	struct xworker_job j;
+	unsigned int i;
+
+	for (i = queue.tail; i != queue.head; i++)
+		if (queue.jobs[i % XWORKER_QUEUE_SIZE].type == XWORKER_MANAGE
+				&& queue.jobs[i % XWORKER_QUEUE_SIZE].win == win
+				&& !queue.jobs[i % XWORKER_QUEUE_SIZE].cancelled)
+			return;
+	if (xworker_submit(XWORKER_MANAGE, win))
+		return;
+	memset(&j, 0, sizeof(j));
+	j.type = XWORKER_MANAGE;
+	j.win = win;
+	j.ws = cw;
+	xworker_run_sync(&j);
+	manage_window(&j);
+}
+
+/**
+ * @brief Store the WM_PROTOCOLS that have been fetched for a client.
+ *
+ * @param j A finished XWORKER_PROTOCOLS job.
+ */
+static void xworker_set_protocols(const struct xworker_job *j)
+{
+	Client *c = find_client_by_win(j->win);
+
+	if (c)
+		c->protocols = j->protocols;
+}
+
+/**
+ * @brief Fetch a client's WM_PROTOCOLS again, once they have changed.
+ *
+ * If the worker can't take the job, they are fetched straight away.
+ *
+ * @param win The client's window.
+ */
+void xworker_protocols(xcb_window_t win)
+{
+	struct xworker_job j;
+
+	if (xworker_submit(XWORKER_PROTOCOLS, win))
+		return;
+	memset(&j, 0, sizeof(j));
+	j.type = XWORKER_PROTOCOLS;
+	j.win = win;
+	xworker_run_sync(&j);
+	xworker_set_protocols(&j);
+}
+
+/**
+ * @brief Forget about a window that has been destroyed, so that it isn't
+ * managed once its properties arrive.
+ *
+ * @param win The window.
+ */
+void xworker_cancel(xcb_window_t win)
+{
+	unsigned int i;
+
+	for (i = queue.tail; i != queue.head; i++)
+		if (queue.jobs[i % XWORKER_QUEUE_SIZE].win == win)
+			queue.jobs[i % XWORKER_QUEUE_SIZE].cancelled = true;
+}
+
+/**
+ * @brief Add the file descriptor that the worker signals to a set.
+ *
+ * @param descs The set of file descriptors to add to.
+ * @param max_fd One more than the largest file descriptor in descs.
+ *
+ * @return One more than the largest file descriptor in descs.
+ */
+int xworker_set_fds(fd_set *descs, int max_fd)
+{
+	if (!started)
+		return max_fd;
+	FD_SET(wake_main, descs);
+	return MAX_FD(wake_main, max_fd - 1);
+}
+
+/**
+ * @brief Manage the windows whose properties the worker has fetched, and
+ * update the WM_PROTOCOLS of the clients that have changed them.
+ *
+ * @param descs The set of file descriptors returned by select.
+ */
+void xworker_handle_fds(fd_set *descs)
+{
+	struct xworker_job *j;
+	unsigned int done;
+
+	if (!started || !FD_ISSET(wake_main, descs))
+		return;
+	clear_fd(wake_main);
+	done = __atomic_load_n(&queue.done, __ATOMIC_ACQUIRE);
+	for (; queue.tail != done; queue.tail++) {
+		j = &queue.jobs[queue.tail % XWORKER_QUEUE_SIZE];
+		if (j->cancelled) {
+			stats.cancelled++;
+			continue;
+		}
+		/* The work that a map request deferred is attributed to it. */
+		if (j->type == XWORKER_MANAGE) {
+			ipc_coalesce_flush();
+			xstats_resume(XSTATS_EVENT(XCB_MAP_REQUEST));
+		}
+		if (j->failed) {
+			if (!broken)
+				log_err("The X worker lost its connection, properties will be fetched synchronously");
+			broken = true;
+			xworker_run_sync(j);
+		} else {
+			stats.jobs[j->type]++;
+		}
+		if (j->type == XWORKER_MANAGE) {
+			manage_window(j);
+			xstats_end();
+		} else {
+			xworker_set_protocols(j);
+		}
+	}
+}
+
+/**
+ * @brief Get the amount of jobs that have been run.
+ */
+const struct xworker_stats *xworker_get(void)
+{
+	return &stats;
+}
+
+/**
+ * @brief Get the name of a kind of job, for metrics.
+ *
+ * @param type The kind of job, from xworker_jobs.
+ */
+const char *xworker_job_name(unsigned int type)
+{
+	return type < XWORKER_JOBS_END ? job_names[type] : "unknown";
+}
+
+/**
+ * @brief Stop the worker and close its connection.
+ *
+ * Jobs that haven't been finished are dropped.
+ */
+void xworker_cleanup(void)
+{
+	if (started) {
+		__atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+		signal_fd(wake_worker);
+		pthread_join(thread, NULL);
+		started = false;
+	}
+	if (wdpy)
+		xcb_disconnect(wdpy);
+	if (wake_main != -1)
+		close(wake_main);
+	if (wake_worker != -1)
+		close(wake_worker);
+	wdpy = NULL;
+	wake_main = wake_worker = -1;
+}
@@ -0,0 +1,72 @@
+#ifndef XWORKER_H
+#define XWORKER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/select.h>
+#include <xcb/xcb.h>
+
+/**
+ * @file xworker.h
+ *
+ * @author Harvey Hunt
+ *
+ * @date 2014
+ *
+ * @brief howm
+ */
+
+/** The most jobs that can be waiting for the worker at once. */
+#define XWORKER_QUEUE_SIZE 64
+
+enum xworker_jobs { XWORKER_MANAGE, XWORKER_PROTOCOLS, XWORKER_JOBS_END };
+
+/**
+ * @brief A window that the worker is fetching the properties of.
+ *
+ * The type and window are written by the main thread before the job is
+ * submitted, the results by whichever side runs the job.
+ */
+struct xworker_job {
+	uint8_t type; /**< The kind of job, from xworker_jobs. */
+	xcb_window_t win; /**< The window that the job is about. */
+	int ws; /**< The workspace that was current when the job was
+		  submitted, which a new window is managed on. */
+	bool cancelled; /**< Has the window gone away since the job was submitted?
+			Only used by the main thread. */
+	bool failed; /**< Did the worker lose its connection before answering? */
+	bool exists; /**< Could the window's attributes be fetched? */
+	bool override_redirect; /**< Should the window be left alone? */
+	bool dock; /**< Is the window a dock or a toolbar? */
+	bool floating; /**< Does the window's type mean that it should float? */
+	bool transient; /**< Is the window transient for another? */
+	bool has_geom; /**< Could the window's geometry be fetched? */
+	uint8_t protocols; /**< The window's WM_PROTOCOLS, from wm_protocols. */
+	int16_t x; /**< The window's initial geometry. */
+	int16_t y;
+	uint16_t w;
+	uint16_t h;
+};
+
+/**
+ * @brief The jobs that have been run.
+ */
+struct xworker_stats {
+	uint64_t jobs[XWORKER_JOBS_END]; /**< Jobs run by the worker, by type. */
+	uint64_t sync; /**< Jobs run on the main thread, as the worker was busy
+			or unavailable. */
+	uint64_t cancelled; /**< Jobs whose window went away before they were
+			answered. */
+};
+
+void xworker_init(void);
+void xworker_manage(xcb_window_t win);
+void xworker_protocols(xcb_window_t win);
+void xworker_cancel(xcb_window_t win);
+int xworker_set_fds(fd_set *descs, int max_fd);
+void xworker_handle_fds(fd_set *descs);
+const struct xworker_stats *xworker_get(void);
+const char *xworker_job_name(unsigned int type);
+void xworker_cleanup(void);
+
+#endif